@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static Arena *arena = nullptr;
+static std::size_t calls = 0;
+
+LUA_DEFINE(ParseHeap)
+{
+	LuaArgs_t args;
+	ParseArguments(L, args);
+	Bench::DoNotOptimize(args);
+	return 0;
+}
+
+LUA_DEFINE(ParseArena)
+{
+	{
+		pmr::LuaArgs_t args(arena->Resource());
+		ParseArguments(L, args);
+		Bench::DoNotOptimize(args);
+	}
+	if (++calls % 100 == 0)
+		arena->Reset();
+	return 0;
+}
+
+// Parsing (string, table with 20 long strings and a nested table, 42) into an argument list
+int main()
+{
+	Arena call_arena(256 * 1024);
+	arena = &call_arena;
+
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction(L, "ParseHeap", ParseHeap);
+	RegisterPluginFunction(L, "ParseArena", ParseArena);
+	luaL_dostring(L, "record = { nested = { 1, 2, 3 } } "
+		"for i = 1, 20 do record[i] = 'a string longer than the inline buffer ' .. i end");
+
+	Bench::Section("parsing arguments, arena reset every 100 calls");
+	Bench::RunLua(L, "LuaArgs_t", 100000,
+		"local n = ... local f = ParseHeap for i = 1, n do f('name', record, 42) end");
+	Bench::RunLua(L, "pmr::LuaArgs_t", 100000,
+		"local n = ... local f = ParseArena for i = 1, n do f('name', record, 42) end");
+	lua_close(L);
+}
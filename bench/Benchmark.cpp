@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#include <atomic>
+#include <cstdlib>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+#include <new>
+
+#include "Benchmark.hpp"
+
+Onset::IServerPlugin *Onset::Plugin::_instance = nullptr;
+
+namespace
+{
+	std::atomic<std::size_t> allocation_count{ 0 };
+}
+
+std::size_t Bench::AllocationCount()
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+// Every benchmark links this, the array and nothrow forms end up here as well. The aligned forms
+// are counted too, std::pmr::new_delete_resource allocates through them.
+void *operator new(std::size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void *memory = std::malloc(size != 0 ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	std::size_t align = static_cast<std::size_t>(alignment);
+	size = (size != 0 ? size : 1);
+#ifdef _MSC_VER
+	void *memory = _aligned_malloc(size, align);
+#else
+	void *memory = std::aligned_alloc(align, (size + align - 1) / align * align); // a multiple of align
+#endif
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+#ifdef _MSC_VER
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(memory, alignment);
+}
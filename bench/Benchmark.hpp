@@ -0,0 +1,131 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+#include <PluginSDK.h>
+
+namespace Bench
+{
+	constexpr int Rounds = 5;
+
+	struct Result
+	{
+		double nanoseconds; // per call, of the fastest round
+		double allocations; // per call, over all rounds
+	};
+
+	// heap allocations made through operator new so far, counted in Benchmark.cpp
+	std::size_t AllocationCount();
+
+	// keeps the compiler from dropping value and the work that produced it
+	template<typename T>
+	inline void DoNotOptimize(T const &value)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		static_cast<void>(*reinterpret_cast<const volatile char *>(&value));
+#else
+		asm volatile("" : : "g"(&value) : "memory");
+#endif
+	}
+
+	// Times batch(iterations), which makes that many calls, in Rounds rounds after a warm-up.
+	// The fastest round is the one least disturbed by the rest of the system.
+	template<typename F>
+	Result MeasureBatch(std::size_t iterations, F &&batch)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		batch(std::max<std::size_t>(iterations / 10, 1));
+
+		double best = 0.0;
+		std::size_t allocations = AllocationCount();
+		for (int round = 0; round < Rounds; ++round)
+		{
+			Clock::time_point start = Clock::now();
+			batch(iterations);
+			double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+			if (round == 0 || elapsed < best)
+				best = elapsed;
+		}
+		allocations = AllocationCount() - allocations;
+
+		double calls = static_cast<double>(iterations);
+		return Result{ best / calls, static_cast<double>(allocations) / (calls * Rounds) };
+	}
+
+	// as MeasureBatch, calling func(i) for every i below iterations
+	template<typename F>
+	inline Result Measure(std::size_t iterations, F &&func)
+	{
+		return MeasureBatch(iterations, [&func](std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				func(i);
+		});
+	}
+
+	// Runs the Lua chunk code with the iteration count as its argument, i.e. code starts with
+	// "local n = ..." and loops n times. Errors are printed and give a time of zero.
+	inline Result MeasureLua(lua_State *state, std::size_t iterations, const char *code)
+	{
+		if (luaL_loadstring(state, code) != LUA_OK)
+		{
+			std::printf("  %s\n", lua_tostring(state, -1));
+			lua_pop(state, 1);
+			return Result{ 0.0, 0.0 };
+		}
+
+		bool failed = false;
+		Result result = MeasureBatch(iterations, [state, &failed](std::size_t count)
+		{
+			lua_pushvalue(state, -1);
+			lua_pushinteger(state, static_cast<lua_Integer>(count));
+			if (!failed && lua_pcall(state, 1, 0, 0) != LUA_OK)
+			{
+				std::printf("  %s\n", lua_tostring(state, -1));
+				lua_pop(state, 1);
+				failed = true;
+			}
+		});
+		lua_pop(state, 1);
+		return failed ? Result{ 0.0, 0.0 } : result;
+	}
+
+	inline void Print(const char *label, Result const &result)
+	{
+		std::printf("  %-52s %10.1f ns %8.2f allocs\n", label, result.nanoseconds, result.allocations);
+	}
+
+	template<typename F>
+	inline void Run(const char *label, std::size_t iterations, F &&func)
+	{
+		Print(label, Measure(iterations, std::forward<F>(func)));
+	}
+
+	inline void RunLua(lua_State *state, const char *label, std::size_t iterations, const char *code)
+	{
+		Print(label, MeasureLua(state, iterations, code));
+	}
+
+	inline void Section(const char *title)
+	{
+		std::printf("%s\n", title);
+	}
+}
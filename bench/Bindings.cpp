@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static int Add(int a, int b)
+{
+	return a + b;
+}
+
+LUA_DEFINE(AddManual)
+{
+	int a, b;
+	ParseArguments(L, a, b);
+	return ReturnValues(L, a + b);
+}
+
+static std::string Concat(std::string const &a, int b)
+{
+	return a + std::to_string(b);
+}
+
+LUA_DEFINE(ConcatManual)
+{
+	std::string a;
+	int b;
+	ParseArguments(L, a, b);
+	return ReturnValues(L, a + std::to_string(b));
+}
+
+static std::size_t Keys(std::string const &name, LuaTable_t table)
+{
+	return name.size() + table->Count();
+}
+
+// Generated bindings against the same functions written with LUA_DEFINE
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction<&Add>(L, "Add");
+	RegisterPluginFunction(L, "AddManual", AddManual);
+	RegisterPluginFunction(L, "AddLambda", [](int a, int b) { return a + b; });
+	RegisterPluginFunction<&Concat>(L, "Concat");
+	RegisterPluginFunction(L, "ConcatManual", ConcatManual);
+	RegisterPluginFunction<&Keys>(L, "Keys");
+
+	Bench::Section("native function bindings");
+	Bench::RunLua(L, "Add(int, int), generated", 5000000,
+		"local n = ... local f, s = Add, 0 for i = 1, n do s = f(s, 1) end");
+	Bench::RunLua(L, "Add(int, int), LUA_DEFINE", 5000000,
+		"local n = ... local f, s = AddManual, 0 for i = 1, n do s = f(s, 1) end");
+	Bench::RunLua(L, "Add(int, int), captureless lambda", 5000000,
+		"local n = ... local f, s = AddLambda, 0 for i = 1, n do s = f(s, 1) end");
+	Bench::RunLua(L, "Concat(std::string const &, int), generated", 2000000,
+		"local n = ... local f = Concat for i = 1, n do f('ab', i) end");
+	Bench::RunLua(L, "Concat(std::string const &, int), LUA_DEFINE", 2000000,
+		"local n = ... local f = ConcatManual for i = 1, n do f('ab', i) end");
+	Bench::RunLua(L, "Keys(std::string const &, LuaTable_t)", 1000000,
+		"local n = ... local f, t = Keys, { a = 1, b = 2, c = 'x' } for i = 1, n do f('ab', t) end");
+	// the error is raised before any argument is converted, so nothing is allocated or leaked
+	Bench::RunLua(L, "Keys(std::string const &, LuaTable_t), cyclic table", 1000000,
+		"local n = ... local f, t = Keys, { a = 1 } t.self = t local name = string.rep('x', 64) "
+		"for i = 1, n do local ok, err = pcall(f, name, t) "
+		"assert(not ok and err:find('reference cycle'), err) end");
+	lua_close(L);
+}
@@ -0,0 +1,56 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+#include <string_view>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static std::size_t total = 0;
+
+LUA_DEFINE(TakeString)
+{
+	std::string message;
+	ParseArguments(L, message);
+	total += message.size();
+	return 0;
+}
+
+LUA_DEFINE(TakeStringView)
+{
+	std::string_view message;
+	ParseArguments(L, message);
+	total += message.size();
+	return 0;
+}
+
+// A native function taking a 32 character chat message, copied or borrowed from Lua
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction(L, "TakeString", TakeString);
+	RegisterPluginFunction(L, "TakeStringView", TakeStringView);
+
+	Bench::Section("native function arguments");
+	Bench::RunLua(L, "std::string", 5000000,
+		"local n = ... local f, s = TakeString, '/say hello everyone on the server' for i = 1, n do f(s) end");
+	Bench::RunLua(L, "std::string_view", 5000000,
+		"local n = ... local f, s = TakeStringView, '/say hello everyone on the server' for i = 1, n do f(s) end");
+	Bench::DoNotOptimize(total);
+	lua_close(L);
+}
@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+#include <unordered_map>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+struct Game
+{
+	int score = 0;
+
+	int AddScore(int points)
+	{
+		score += points;
+		return score;
+	}
+};
+
+static std::unordered_map<std::string, Game *> games;
+
+LUA_DEFINE(AddScoreGlobal)
+{
+	int points;
+	ParseArguments(L, points);
+	return ReturnValues(L, games["main"]->AddScore(points));
+}
+
+// A native function reaching its context through a global lookup, a bound member and a closure
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Game game;
+	games["main"] = &game;
+	RegisterPluginFunction(L, "AddScoreGlobal", AddScoreGlobal);
+	RegisterPluginFunction<&Game::AddScore>(L, "AddScoreMethod", &game);
+	RegisterPluginFunction(L, "AddScoreClosure", [&game, name = std::string("main")](int points)
+	{
+		return game.AddScore(points);
+	});
+
+	Bench::Section("native functions with context");
+	Bench::RunLua(L, "LUA_DEFINE and global unordered_map lookup", 5000000,
+		"local n = ... local f = AddScoreGlobal for i = 1, n do f(1) end");
+	Bench::RunLua(L, "member function binding", 5000000,
+		"local n = ... local f = AddScoreMethod for i = 1, n do f(1) end");
+	Bench::RunLua(L, "closure capturing the object", 5000000,
+		"local n = ... local f = AddScoreClosure for i = 1, n do f(1) end");
+	lua_close(L);
+}
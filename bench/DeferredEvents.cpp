@@ -0,0 +1,152 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "MockServer.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t Events = 200000;
+
+// Times post(i) for Events events per round and then finish() untimed, or timed on its own if
+// finish_nanoseconds is given. Returns the fastest round of each per event.
+template<typename Post, typename Finish>
+static Bench::Result TimeRounds(Post &&post, Finish &&finish, double *finish_nanoseconds = nullptr)
+{
+	double best = 0.0, best_finish = 0.0;
+	std::size_t allocations = Bench::AllocationCount();
+	for (int round = 0; round < Bench::Rounds; ++round)
+	{
+		Clock::time_point start = Clock::now();
+		for (std::size_t i = 0; i < Events; ++i)
+			post(i);
+		Clock::time_point posted = Clock::now();
+		finish();
+		Clock::time_point finished = Clock::now();
+
+		double elapsed = std::chrono::duration<double, std::nano>(posted - start).count();
+		double elapsed_finish = std::chrono::duration<double, std::nano>(finished - posted).count();
+		best = (round == 0 || elapsed < best) ? elapsed : best;
+		best_finish = (round == 0 || elapsed_finish < best_finish) ? elapsed_finish : best_finish;
+	}
+	allocations = Bench::AllocationCount() - allocations;
+
+	if (finish_nanoseconds != nullptr)
+		*finish_nanoseconds = best_finish / Events;
+	return Bench::Result{ best / Events, static_cast<double>(allocations) / (Events * Bench::Rounds) };
+}
+
+// producers threads post Events events between them while this thread drains them. Returns the
+// wall time per event
+template<typename Post, typename Drain>
+static double Contended(int producers, Post &&post, Drain &&drain)
+{
+	Clock::time_point start = Clock::now();
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < producers; ++thread)
+	{
+		threads.emplace_back([&post, producers]
+		{
+			for (std::size_t i = 0; i < Events / producers; ++i)
+				post(i);
+		});
+	}
+
+	std::size_t drained = 0;
+	while (drained < Events / producers * producers)
+		drained += drain();
+	for (std::thread &thread : threads)
+		thread.join();
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Events;
+}
+
+// A mutex guarded vector, what plugins used before DeferredEventQueue
+struct MutexQueue
+{
+	std::mutex mutex;
+	std::vector<std::pair<std::string, Lua::LuaArgs_t>> events;
+
+	void Post(const char *name, int id, double value)
+	{
+		Lua::LuaArgs_t args{ id, value };
+		std::lock_guard<std::mutex> lock(mutex);
+		events.emplace_back(name, std::move(args));
+	}
+
+	std::size_t Drain()
+	{
+		std::vector<std::pair<std::string, Lua::LuaArgs_t>> drained;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			drained.swap(events);
+		}
+		for (auto &event : drained)
+			Onset::Plugin::Get()->CallEvent(event.first.c_str(), &event.second);
+		return drained.size();
+	}
+};
+
+// Posting (int, double) events on one thread and draining them on the game thread, against a
+// mutex guarded vector
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Bench::MockServer server(L);
+	Onset::Plugin::Init(&server);
+	luaL_dostring(L, "AddEvent('OnWorkDone', function(id, value) end)");
+
+	Bench::Section("deferred events, per event");
+	{
+		Onset::DeferredEventQueue queue(1000.0);
+		double drain = 0.0;
+		Bench::Result post = TimeRounds([&queue](std::size_t i) { queue.Post("OnWorkDone", static_cast<int>(i), 1.5); },
+			[&queue] { queue.Drain(); }, &drain);
+		Bench::Print("DeferredEventQueue::Post", post);
+		Bench::Print("DeferredEventQueue::Drain, including CallEvent", Bench::Result{ drain, 0.0 });
+	}
+	{
+		MutexQueue queue;
+		Bench::Print("mutex and vector push of the same arguments", TimeRounds([&queue](std::size_t i)
+		{
+			queue.Post("OnWorkDone", static_cast<int>(i), 1.5);
+		}, [&queue] { queue.events.clear(); }));
+	}
+
+	Bench::Section("deferred events, 4 producers and draining concurrently, per event");
+	for (int round = 0; round < 3; ++round)
+	{
+		Onset::DeferredEventQueue lock_free(1000.0);
+		MutexQueue locked;
+		double lock_free_ns = Contended(4,
+			[&lock_free](std::size_t i) { lock_free.Post("OnWorkDone", static_cast<int>(i), 1.5); },
+			[&lock_free] { return lock_free.Drain(); });
+		double locked_ns = Contended(4,
+			[&locked](std::size_t i) { locked.Post("OnWorkDone", static_cast<int>(i), 1.5); },
+			[&locked] { return locked.Drain(); });
+		std::printf("  DeferredEventQueue %10.1f ns    mutex and vector %10.1f ns\n", lock_free_ns, locked_ns);
+	}
+
+	Onset::Plugin::Init(nullptr);
+	lua_close(L);
+}
@@ -0,0 +1,55 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+
+#include "Benchmark.hpp"
+#include "MockServer.hpp"
+
+// Calling an event through a LuaArgs_t against pushing the arguments directly
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Bench::MockServer server(L);
+	Onset::Plugin::Init(&server);
+	luaL_dostring(L, "AddEvent('OnMove', function(id, x, y, z) end) AddEvent('OnChat', function(id, message) end)");
+
+	Onset::IServerPlugin *plugin = Onset::Plugin::Get();
+	std::string message = "hello there, a chat message longer than inline";
+
+	Bench::Section("CallEvent, one empty handler");
+	Bench::Run("OnMove(id, x, y, z), LuaArgs_t", 2000000, [plugin](std::size_t i)
+	{
+		Lua::LuaArgs_t args = Lua::BuildArgumentList(static_cast<int>(i), 1.f, 2.f, 3.f);
+		plugin->CallEvent("OnMove", &args);
+	});
+	Bench::Run("OnMove(id, x, y, z), direct", 2000000, [plugin](std::size_t i)
+	{
+		plugin->CallEvent("OnMove", static_cast<int>(i), 1.f, 2.f, 3.f);
+	});
+	Bench::Run("OnChat(id, message), LuaArgs_t", 2000000, [plugin, &message](std::size_t i)
+	{
+		Lua::LuaArgs_t args = Lua::BuildArgumentList(static_cast<int>(i), message);
+		plugin->CallEvent("OnChat", &args);
+	});
+	Bench::Run("OnChat(id, message), direct", 2000000, [plugin, &message](std::size_t i)
+	{
+		plugin->CallEvent("OnChat", static_cast<int>(i), message);
+	});
+
+	Onset::Plugin::Init(nullptr);
+	lua_close(L);
+}
@@ -0,0 +1,60 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+#include "MockServer.hpp"
+
+using PlayerEvents = Onset::EventBatch<int, float, float, float>;
+
+static void Flush(const char *label, PlayerEvents &events)
+{
+	Bench::Run(label, 5000, [&events](std::size_t)
+	{
+		for (int id = 0; id < 300; ++id)
+			events.Add(id, 1.f, 2.f, 3.f);
+		events.Flush();
+	});
+}
+
+// One event per player for 300 players each tick, called singly and as a batch
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Bench::MockServer server(L);
+	Onset::Plugin::Init(&server);
+	luaL_dostring(L, "AddEvent('OnSingle', function(id, x, y, z) end) "
+		"AddEvent('OnBatch', function(id, x, y, z) end) "
+		"AddEvent('OnTable', function(batch) end, true) "
+		"AddEvent('OnTableRead', function(batch) local ids, xs = batch[1], batch[2] "
+		"for i = 1, batch.n do local id, x = ids[i], xs[i] end end, true)");
+
+	Onset::IServerPlugin *plugin = Onset::Plugin::Get();
+	Onset::EventHandle single = plugin->ResolveEvent("OnSingle");
+	PlayerEvents batch("OnBatch"), table("OnTable"), table_read("OnTableRead");
+
+	Bench::Section("300 events per tick, per tick");
+	Bench::Run("300 x CallEvent(handle, ...)", 5000, [plugin, single](std::size_t)
+	{
+		for (int id = 0; id < 300; ++id)
+			plugin->CallEvent(single, id, 1.f, 2.f, 3.f);
+	});
+	Flush("EventBatch::Flush, per-entry mode", batch);
+	Flush("EventBatch::Flush, table mode", table);
+	Flush("EventBatch::Flush, table mode reading 2 columns", table_read);
+
+	Onset::Plugin::Init(nullptr);
+	lua_close(L);
+}
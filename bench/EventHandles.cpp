@@ -0,0 +1,50 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+#include "MockServer.hpp"
+
+static Onset::Event on_shot("OnPlayerWeaponShotCustom");
+
+// Calling an event by name, by resolved handle and through Onset::Event, among 51 events
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Bench::MockServer server(L);
+	Onset::Plugin::Init(&server);
+	luaL_dostring(L, "for i = 1, 50 do AddEvent('OnSomeOtherEvent' .. i, function() end) end "
+		"AddEvent('OnPlayerWeaponShotCustom', function(id, damage) end)");
+
+	Onset::IServerPlugin *plugin = Onset::Plugin::Get();
+	Onset::EventHandle handle = plugin->ResolveEvent("OnPlayerWeaponShotCustom");
+
+	Bench::Section("CallEvent, 51 events");
+	Bench::Run("CallEvent(\"OnPlayerWeaponShotCustom\", ...)", 2000000, [plugin](std::size_t i)
+	{
+		plugin->CallEvent("OnPlayerWeaponShotCustom", static_cast<int>(i), 1.f);
+	});
+	Bench::Run("CallEvent(handle, ...)", 2000000, [plugin, handle](std::size_t i)
+	{
+		plugin->CallEvent(handle, static_cast<int>(i), 1.f);
+	});
+	Bench::Run("Onset::Event::Call(...)", 2000000, [](std::size_t i)
+	{
+		on_shot.Call(static_cast<int>(i), 1.f);
+	});
+
+	Onset::Plugin::Init(nullptr);
+	lua_close(L);
+}
@@ -0,0 +1,59 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+#include "MockServer.hpp"
+
+// Asking two handlers "may this player enter", with a second call reading a global and with
+// CallEventResults
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Bench::MockServer server(L);
+	Onset::Plugin::Init(&server);
+	luaL_dostring(L, R"lua(
+		AddEvent('CanEnter', function(player, vehicle) return true end)
+		AddEvent('CanEnter', function(player, vehicle) return vehicle ~= 3 end)
+		AddEvent('CanEnterGlobal', function(player, vehicle) allowed = true end)
+		AddEvent('CanEnterGlobal', function(player, vehicle) allowed = allowed and vehicle ~= 3 end)
+		function GetAllowed() return allowed end
+	)lua");
+
+	Onset::IServerPlugin *plugin = Onset::Plugin::Get();
+	Onset::EventHandle can_enter = plugin->ResolveEvent("CanEnter");
+	Onset::EventHandle can_enter_global = plugin->ResolveEvent("CanEnterGlobal");
+	Lua::LuaFunction get_allowed(L, "GetAllowed");
+
+	Bench::Section("event results, two handlers");
+	Bench::Run("CallEvent and a second call reading the answer", 2000000,
+		[plugin, can_enter_global, &get_allowed](std::size_t i)
+	{
+		plugin->CallEvent(can_enter_global, static_cast<int>(i), 7);
+		bool allowed = get_allowed.Call<bool>().Value();
+		Bench::DoNotOptimize(allowed);
+	});
+	Bench::Run("CallEventResults with AllTrue", 2000000, [plugin, can_enter](std::size_t i)
+	{
+		Onset::AllTrue all_true;
+		plugin->CallEventResults(can_enter, all_true, static_cast<int>(i), 7);
+		bool allowed = all_true.Result();
+		Bench::DoNotOptimize(allowed);
+	});
+
+	get_allowed = Lua::LuaFunction();
+	Onset::Plugin::Init(nullptr);
+	lua_close(L);
+}
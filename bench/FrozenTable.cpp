@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static LuaTable_t plain, frozen;
+
+LUA_DEFINE(ReturnPlain)
+{
+	return ReturnValues(L, plain);
+}
+
+LUA_DEFINE(ReturnFrozen)
+{
+	return ReturnValues(L, frozen);
+}
+
+// Returning the same 200 entry table from a native function, copied each time or frozen
+int main()
+{
+	plain = LuaTable::Create();
+	for (int i = 1; i <= 100; ++i)
+	{
+		plain->Add(i, i * 2);
+		plain->Add("item" + std::to_string(i), "value");
+	}
+	frozen = LuaTable_t(new LuaTable(*plain));
+	frozen->Freeze();
+
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction(L, "ReturnPlain", ReturnPlain);
+	RegisterPluginFunction(L, "ReturnFrozen", ReturnFrozen);
+
+	Bench::Section("returning a 200 entry table");
+	Bench::RunLua(L, "plain", 100000, "local n = ... local f = ReturnPlain for i = 1, n do f() end");
+	Bench::RunLua(L, "frozen", 100000, "local n = ... local f = ReturnFrozen for i = 1, n do f() end");
+	lua_close(L);
+	plain.reset();
+	frozen.reset();
+}
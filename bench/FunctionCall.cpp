@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+// Calling a Lua function (a, b) -> a + b from C++
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	luaL_dostring(L, "function add(a, b) return a + b end");
+	LuaFunction add(L, "add");
+
+	Bench::Section("calling Lua from C++");
+	Bench::Run("LuaFunction::Call<int>(i, 2)", 1000000, [&add](std::size_t i)
+	{
+		int sum = add.Call<int>(static_cast<int>(i), 2).Value();
+		Bench::DoNotOptimize(sum);
+	});
+	Bench::Run("LuaArgs_t, lua_pcall and ParseValueFromLua", 1000000, [L, &add](std::size_t i)
+	{
+		LuaArgs_t args{ LuaValue(static_cast<int>(i)), LuaValue(2) };
+		int top = lua_gettop(L);
+		add.PushToLua(L);
+		int count = ReturnValues(L, args);
+		if (lua_pcall(L, count, LUA_MULTRET, 0) == LUA_OK)
+		{
+			LuaArgs_t results;
+			for (int index = top + 1; index <= lua_gettop(L); ++index)
+				results.push_back(ParseValueFromLua(L, index));
+			int sum = 0;
+			results[0].TryGetValue(sum);
+			Bench::DoNotOptimize(sum);
+		}
+		lua_settop(L, top);
+	});
+	add = LuaFunction();
+	lua_close(L);
+}
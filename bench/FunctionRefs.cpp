@@ -0,0 +1,59 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <vector>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+// Referencing a Lua function from native code, with 2000 other references alive
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	luaL_dostring(L, "function add(a, b) return a + b end");
+	lua_getglobal(L, "add");
+
+	std::vector<LuaFunction_t> alive;
+	for (int i = 0; i < 2000; ++i)
+	{
+		LuaFunction_t function(new LuaFunction(L));
+		function->ParseFromLua(-1);
+		alive.push_back(function);
+	}
+
+	Bench::Section("LuaFunction references");
+	Bench::Run("PushToLua", 10000000, [L, &alive](std::size_t)
+	{
+		alive[0]->PushToLua(L);
+		lua_pop(L, 1);
+	});
+	Bench::Run("LuaFunction_t ref and unref", 1000000, [L](std::size_t)
+	{
+		LuaFunction_t function(new LuaFunction(L));
+		function->ParseFromLua(-1);
+		Bench::DoNotOptimize(function);
+	});
+	Bench::Run("LuaFunction by value, ref and unref", 1000000, [L](std::size_t)
+	{
+		LuaFunction function(L);
+		function.ParseFromLua(-1);
+		Bench::DoNotOptimize(function);
+	});
+
+	alive.clear();
+	lua_close(L);
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static const char *const field_names[] = { "health", "armor", "position_x", "position_y", "position_z",
+	"heading", "vehicle_id", "dimension", "weapon_slot", "last_damage_time", "account_identifier", "is_admin" };
+constexpr std::size_t FieldCount = sizeof(field_names) / sizeof(field_names[0]);
+
+template<typename K>
+static void LookUp(const char *label, LuaTable_t const &table, K const *keys)
+{
+	Bench::Run(label, 2000000, [&table, keys](std::size_t i)
+	{
+		int value = 0;
+		table->TryGet(keys[i % FieldCount], value);
+		Bench::DoNotOptimize(value);
+	});
+}
+
+// TryGet spread over the 12 fields of a player record, by the kind of key
+int main()
+{
+	LuaTable_t table = LuaTable::Create();
+	LuaTable_t interned_table = LuaTable::Create();
+	std::string strings[FieldCount];
+	LuaValue atoms[FieldCount];
+	for (std::size_t i = 0; i < FieldCount; ++i)
+	{
+		strings[i] = field_names[i];
+		atoms[i] = LuaValue::Intern(field_names[i]);
+		table->Add(field_names[i], static_cast<int>(i));
+		interned_table->Add(atoms[i], static_cast<int>(i));
+	}
+
+	Bench::Section("LuaTable::TryGet, 12 entries");
+	LookUp("const char* key", table, field_names);
+	LookUp("std::string key", table, strings);
+	LookUp("interned key", table, atoms);
+	LookUp("interned key, interned entries", interned_table, atoms);
+}
@@ -0,0 +1,42 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#include <string>
+
+#include "Benchmark.hpp"
+
+// Copying the argument list of a typical event: ints, floats, short names, a bool and a table
+int main()
+{
+	using namespace Lua;
+
+	LuaTable_t table = LuaTable::Create();
+	LuaArgs_t args = BuildArgumentList(12, 3, 1.25, 0.5, "m4a1", "Vehicle_12", std::string("player_joined"),
+		7, true, table);
+
+	Bench::Section("LuaValue");
+	std::printf("  sizeof(LuaValue) %zu bytes, 10 arguments %zu bytes\n", sizeof(LuaValue),
+		args.size() * sizeof(LuaValue));
+	Bench::Run("copy a 10 argument LuaArgs_t", 2000000, [&args](std::size_t)
+	{
+		LuaArgs_t copy = args;
+		Bench::DoNotOptimize(copy);
+	});
+	Bench::Run("copy a 40 character string value", 5000000, [](std::size_t)
+	{
+		static const LuaValue value("a string longer than the inline buffer..");
+		LuaValue copy = value;
+		Bench::DoNotOptimize(copy);
+	});
+}
@@ -0,0 +1,300 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <PluginSDK.h>
+
+namespace Bench
+{
+	// The server side of IServerPlugin for one Lua state, just enough to call events. Lua adds
+	// handlers with AddEvent(name, handler[, batch]); handles index the events resolved so far.
+	// Native listeners run after the Lua handlers of CallEvent by name, deferred event queues
+	// are drained by Frame().
+	class MockServer : public Onset::IServerPlugin
+	{
+	private:
+		struct Handler
+		{
+			int ref;
+			bool batch; // takes a table of all entries in CallEventBatch
+		};
+
+		struct Listener
+		{
+			std::string event;
+			Onset::NativeEventListenerFn func; // nullptr once removed
+			void *context;
+			void (*destroy)(void *context);
+		};
+
+		// the light userdata argument of CallListener
+		struct ListenerCall
+		{
+			Listener const *listener;
+			Lua::PushArgumentsFn push;
+			void *context;
+		};
+
+		lua_State *_state;
+		std::unordered_map<std::string, std::vector<Handler>> _events;
+		std::vector<std::vector<Handler> *> _resolved; // the handle is the index plus one
+		std::vector<Listener> _listeners;
+		std::vector<std::pair<Onset::DrainDeferredEventsFn, void *>> _queues;
+
+	public:
+		explicit MockServer(lua_State *state) : _state(state)
+		{
+			lua_pushlightuserdata(_state, this);
+			lua_pushcclosure(_state, &AddEvent, 1);
+			lua_setglobal(_state, "AddEvent");
+		}
+		~MockServer()
+		{
+			for (Listener &listener : _listeners)
+			{
+				if (listener.func != nullptr && listener.destroy != nullptr)
+					listener.destroy(listener.context);
+			}
+		}
+
+		MockServer(MockServer const &) = delete;
+		MockServer &operator=(MockServer const &) = delete;
+
+	public:
+		// drains the deferred event queues like the server does every frame
+		std::size_t Frame()
+		{
+			std::size_t count = 0;
+			for (auto const &queue : _queues)
+				count += queue.first(queue.second);
+			return count;
+		}
+
+		using Onset::IServerPlugin::CallEvent;
+
+		void Log(const char *format, ...) override
+		{
+			va_list args;
+			va_start(args, format);
+			std::vprintf(format, args);
+			va_end(args);
+			std::printf("\n");
+		}
+
+		double GetTimeSeconds() override
+		{
+			return 0.0;
+		}
+
+		float GetDeltaSeconds() override
+		{
+			return 0.f;
+		}
+
+		bool CallEvent(const char *EventName, Lua::LuaArgs_t *Arguments) override
+		{
+			auto it = _events.find(EventName);
+			if (it == _events.end())
+				return false;
+
+			for (Handler const &handler : it->second)
+			{
+				lua_rawgeti(_state, LUA_REGISTRYINDEX, handler.ref);
+				int count = Arguments != nullptr ? Lua::ReturnValues(_state, *Arguments) : 0;
+				Call(count, 0);
+			}
+			return true;
+		}
+
+		void CallRemoteEvent(const char *, Lua::LuaArgs_t *) override
+		{ }
+
+		bool CallEvent(const char *EventName, Lua::PushArgumentsFn PushArguments, void *Context) override
+		{
+			auto it = _events.find(EventName);
+			if (it != _events.end())
+			{
+				for (Handler const &handler : it->second)
+					CallHandler(handler.ref, PushArguments, Context);
+			}
+			CallListeners(EventName, PushArguments, Context);
+			return it != _events.end();
+		}
+
+		Onset::EventHandle ResolveEvent(const char *EventName, std::uint64_t) override
+		{
+			auto it = _events.find(EventName);
+			if (it == _events.end())
+				return Onset::EventHandle::Invalid;
+
+			_resolved.push_back(&it->second);
+			return static_cast<Onset::EventHandle>(_resolved.size());
+		}
+
+		bool CallEvent(Onset::EventHandle Event, Lua::PushArgumentsFn PushArguments, void *Context) override
+		{
+			std::vector<Handler> *handlers = Find(Event);
+			if (handlers == nullptr)
+				return false;
+
+			for (Handler const &handler : *handlers)
+				CallHandler(handler.ref, PushArguments, Context);
+			return true;
+		}
+
+		bool CallEventBatch(Onset::EventHandle Event, std::size_t Count, Lua::PushBatchArgumentsFn PushArguments,
+			void *Context) override
+		{
+			std::vector<Handler> *handlers = Find(Event);
+			if (handlers == nullptr)
+				return false;
+
+			auto on_error = [this](const char *message) { Log("%s", message); };
+			for (Handler const &handler : *handlers)
+			{
+				lua_rawgeti(_state, LUA_REGISTRYINDEX, handler.ref);
+				if (handler.batch)
+					Lua::CallBatchTable(_state, -1, Count, PushArguments, Context, on_error);
+				else
+					Lua::CallBatch(_state, -1, Count, PushArguments, Context, on_error);
+				lua_pop(_state, 1);
+			}
+			return true;
+		}
+
+		bool CallEventResults(Onset::EventHandle Event, Lua::PushArgumentsFn PushArguments, void *Context,
+			Lua::CollectResultsFn CollectResults, void *ResultsContext) override
+		{
+			std::vector<Handler> *handlers = Find(Event);
+			if (handlers == nullptr)
+				return false;
+
+			for (Handler const &handler : *handlers)
+			{
+				int base = lua_gettop(_state);
+				lua_rawgeti(_state, LUA_REGISTRYINDEX, handler.ref);
+				if (!Call(PushArguments(_state, Context), LUA_MULTRET))
+					continue;
+
+				bool go_on = CollectResults(_state, base + 1, lua_gettop(_state) - base, ResultsContext);
+				lua_settop(_state, base);
+				if (!go_on)
+					break;
+			}
+			return true;
+		}
+
+		Onset::NativeListenerHandle AddNativeEventListener(const char *EventName, Onset::NativeEventListenerFn Listener,
+			void *Context, void (*DestroyContext)(void *Context)) override
+		{
+			_listeners.push_back({ EventName, Listener, Context, DestroyContext });
+			return static_cast<Onset::NativeListenerHandle>(_listeners.size());
+		}
+
+		void RemoveNativeEventListener(Onset::NativeListenerHandle Listener) override
+		{
+			auto &listener = _listeners[static_cast<std::size_t>(Listener) - 1];
+			if (listener.func != nullptr && listener.destroy != nullptr)
+				listener.destroy(listener.context);
+			listener.func = nullptr;
+		}
+
+		void AddDeferredEventQueue(Onset::DrainDeferredEventsFn Drain, void *Context) override
+		{
+			_queues.emplace_back(Drain, Context);
+		}
+
+		void RemoveDeferredEventQueue(void *Context) override
+		{
+			for (auto it = _queues.begin(); it != _queues.end(); ++it)
+			{
+				if (it->second == Context)
+				{
+					_queues.erase(it);
+					return;
+				}
+			}
+		}
+
+	private:
+		// AddEvent(name, handler[, batch]), the server is the upvalue
+		static int AddEvent(lua_State *state)
+		{
+			MockServer *server = static_cast<MockServer *>(lua_touserdata(state, lua_upvalueindex(1)));
+			const char *name = luaL_checkstring(state, 1);
+			luaL_checktype(state, 2, LUA_TFUNCTION);
+			bool batch = lua_toboolean(state, 3) != 0;
+			lua_pushvalue(state, 2);
+			server->_events[name].push_back({ luaL_ref(state, LUA_REGISTRYINDEX), batch });
+			return 0;
+		}
+
+		std::vector<Handler> *Find(Onset::EventHandle handle)
+		{
+			std::size_t index = static_cast<std::size_t>(handle);
+			if (index == 0 || index > _resolved.size())
+				return nullptr;
+			return _resolved[index - 1];
+		}
+
+		// calls the function below count arguments, logging errors. Results stay on the stack.
+		bool Call(int count, int results)
+		{
+			if (lua_pcall(_state, count, results, 0) == LUA_OK)
+				return true;
+
+			Log("%s", lua_tostring(_state, -1));
+			lua_pop(_state, 1);
+			return false;
+		}
+
+		void CallHandler(int ref, Lua::PushArgumentsFn push, void *context)
+		{
+			lua_rawgeti(_state, LUA_REGISTRYINDEX, ref);
+			Call(push(_state, context), 0);
+		}
+
+		void CallListeners(const char *event, Lua::PushArgumentsFn push, void *context)
+		{
+			for (Listener const &listener : _listeners)
+			{
+				if (listener.func == nullptr || listener.event != event)
+					continue;
+
+				ListenerCall call{ &listener, push, context };
+				lua_pushcfunction(_state, &CallListener);
+				lua_pushlightuserdata(_state, &call);
+				Call(1, 0);
+			}
+		}
+
+		// protected part of CallListeners, the ListenerCall is at 1
+		static int CallListener(lua_State *state)
+		{
+			ListenerCall *call = static_cast<ListenerCall *>(lua_touserdata(state, 1));
+			int count = call->push(state, call->context);
+			call->listener->func(Lua::LuaArgsView(state, -count, count), call->listener->context);
+			return 0;
+		}
+	};
+}
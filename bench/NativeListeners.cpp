@@ -0,0 +1,60 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+#include <string_view>
+
+#include "Benchmark.hpp"
+#include "MockServer.hpp"
+
+static std::size_t total = 0;
+
+static void NativeOnChat(int id, std::string message)
+{
+	total += static_cast<std::size_t>(id) + message.size();
+}
+
+// Receiving a chat event in C++ through a Lua handler calling a bound function, and through a
+// native listener
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	Bench::MockServer server(L);
+	Onset::Plugin::Init(&server);
+	Lua::RegisterPluginFunction<&NativeOnChat>(L, "NativeOnChat");
+	luaL_dostring(L, "AddEvent('OnChatLua', function(id, message) NativeOnChat(id, message) end)");
+
+	Onset::IServerPlugin *plugin = Onset::Plugin::Get();
+	plugin->AddNativeEventListener("OnChatNative", [](Lua::LuaArgsView const &args)
+	{
+		total += static_cast<std::size_t>(args.Get<int>(0)) + args.Get<std::string_view>(1).size();
+	});
+	std::string message = "a chat message that is longer than the inline buffer";
+
+	Bench::Section("native event listeners");
+	Bench::Run("Lua handler calling a bound NativeOnChat", 2000000, [plugin, &message](std::size_t i)
+	{
+		plugin->CallEvent("OnChatLua", static_cast<int>(i), message);
+	});
+	Bench::Run("native listener reading int and string_view", 2000000, [plugin, &message](std::size_t i)
+	{
+		plugin->CallEvent("OnChatNative", static_cast<int>(i), message);
+	});
+	Bench::DoNotOptimize(total);
+
+	Onset::Plugin::Init(nullptr);
+	lua_close(L);
+}
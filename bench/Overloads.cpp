@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string_view>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static int ById(int id)
+{
+	return id;
+}
+
+static int ByName(std::string_view name)
+{
+	return static_cast<int>(name.size());
+}
+
+static int ByPosition(float x, float y, float z)
+{
+	return static_cast<int>(x + y + z);
+}
+
+LUA_DEFINE(TypeSwitch)
+{
+	if (lua_gettop(L) == 1 && lua_type(L, 1) == LUA_TNUMBER)
+	{
+		int id;
+		ParseArguments(L, id);
+		return ReturnValues(L, ById(id));
+	}
+	if (lua_gettop(L) == 1 && lua_type(L, 1) == LUA_TSTRING)
+	{
+		std::string_view name;
+		ParseArguments(L, name);
+		return ReturnValues(L, ByName(name));
+	}
+	float x, y, z;
+	ParseArguments(L, x, y, z);
+	return ReturnValues(L, ByPosition(x, y, z));
+}
+
+// Generated overload dispatch against a hand-written type switch and a single binding
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction<&ById, &ByName, &ByPosition>(L, "Overloaded");
+	RegisterPluginFunction(L, "TypeSwitch", TypeSwitch);
+	RegisterPluginFunction<&ById>(L, "Single");
+
+	Bench::Section("overloaded native functions");
+	Bench::RunLua(L, "f(i), overloaded", 3000000, "local n = ... local f = Overloaded for i = 1, n do f(i) end");
+	Bench::RunLua(L, "f(i), type switch", 3000000, "local n = ... local f = TypeSwitch for i = 1, n do f(i) end");
+	Bench::RunLua(L, "f(i), single binding", 3000000, "local n = ... local f = Single for i = 1, n do f(i) end");
+	Bench::RunLua(L, "f(1, 2, 3), overloaded", 3000000,
+		"local n = ... local f = Overloaded for i = 1, n do f(1, 2, 3) end");
+	Bench::RunLua(L, "f(1, 2, 3), type switch", 3000000,
+		"local n = ... local f = TypeSwitch for i = 1, n do f(1, 2, 3) end");
+	lua_close(L);
+}
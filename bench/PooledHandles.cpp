@@ -0,0 +1,42 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+LUA_DEFINE(Parse)
+{
+	LuaArgs_t args;
+	ParseArguments(L, args);
+	Bench::DoNotOptimize(args);
+	return 0;
+}
+
+// Parsing (table with 5 nested tables and a function, function, 1) into an argument list,
+// which creates 6 LuaTable and 2 LuaFunction objects per call
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction(L, "Parse", Parse);
+	luaL_dostring(L, "record = { a = { 1, 2 }, b = { x = 1 }, c = {}, d = { {}, {} }, f = print } "
+		"callback = function() end");
+
+	Bench::Section(ONSET_SDK_ATOMIC_REFCOUNT ? "pooled handles" : "pooled handles, non-atomic reference counts");
+	Bench::RunLua(L, "ParseArguments into LuaArgs_t", 100000,
+		"local n = ... local f = Parse for i = 1, n do f(record, callback, 1) end");
+	lua_close(L);
+}
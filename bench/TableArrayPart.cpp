@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+// A 500 element integer sequence, which lives in the array part of LuaTable
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	luaL_dostring(L, "local t = {} for i = 1, 500 do t[i] = i * 3 end return t");
+
+	Bench::Section("LuaTable array part, 500 element sequence");
+	Bench::Run("ParseFromLua", 20000, [L](std::size_t)
+	{
+		LuaTable table;
+		table.ParseFromLua(L, 1);
+		Bench::DoNotOptimize(table);
+	});
+
+	LuaTable table;
+	table.ParseFromLua(L, 1);
+	lua_settop(L, 0);
+	Bench::Run("PushToLua", 20000, [L, &table](std::size_t i)
+	{
+		table.PushToLua(L);
+		lua_pop(L, 1);
+		if (i % 100 == 0)
+			lua_gc(L, LUA_GCCOLLECT, 0);
+	});
+	Bench::Run("TryGet(int), per call", 10000000, [&table](std::size_t i)
+	{
+		int value = 0;
+		table.TryGet(static_cast<int>(i % 500) + 1, value);
+		Bench::DoNotOptimize(value);
+	});
+	lua_close(L);
+}
@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <functional>
+#include <string>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+using Visitor = std::function<void(LuaValue const &, LuaValue const &)>;
+
+// how ForEach was called before it became a template
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+static void ForEachFunction(LuaTable const &table, Visitor const &visit)
+{
+	table.ForEach(visit);
+}
+
+static void Sum(const char *part, LuaTable const &table)
+{
+	char label[64];
+	std::snprintf(label, sizeof(label), "%s, std::function", part);
+	Bench::Run(label, 100, [&table](std::size_t)
+	{
+		long long sum = 0;
+		ForEachFunction(table, [&sum](LuaValue const &, LuaValue const &value) { sum += value.AsInteger(); });
+		Bench::DoNotOptimize(sum);
+	});
+	std::snprintf(label, sizeof(label), "%s, template", part);
+	Bench::Run(label, 100, [&table](std::size_t)
+	{
+		long long sum = 0;
+		table.ForEach([&sum](LuaValue const &, LuaValue const &value) { sum += value.AsInteger(); });
+		Bench::DoNotOptimize(sum);
+	});
+	std::snprintf(label, sizeof(label), "%s, range-for", part);
+	Bench::Run(label, 100, [&table](std::size_t)
+	{
+		long long sum = 0;
+		for (auto [key, value] : table)
+			sum += value.AsInteger();
+		Bench::DoNotOptimize(sum);
+	});
+}
+
+// Summing the values of a 100k entry table, per pass
+int main()
+{
+	LuaTable array, hash;
+	for (int i = 1; i <= 100000; ++i)
+	{
+		array.Add(i, i);
+		hash.Add("k" + std::to_string(i), i);
+	}
+
+	Bench::Section("LuaTable iteration, 100k entries");
+	Sum("array part", array);
+	Sum("hash part", hash);
+}
@@ -0,0 +1,68 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+// Insert, lookup and ForEach per entry of tables with string keys "key_<n>" of several sizes
+int main()
+{
+	Bench::Section("LuaTable hash part, per entry");
+	for (std::size_t size : { 10, 1000, 100000 })
+	{
+		std::vector<std::string> keys;
+		for (std::size_t i = 0; i < size; ++i)
+			keys.push_back("key_" + std::to_string(i));
+		std::size_t iterations = std::max<std::size_t>(2000000 / size, 3) * size;
+
+		LuaTable table;
+		for (std::size_t i = 0; i < size; ++i)
+			table.Add(keys[i], static_cast<int>(i));
+
+		char label[64];
+		std::snprintf(label, sizeof(label), "insert, %zu entries", size);
+		Bench::Print(label, Bench::MeasureBatch(iterations, [&keys, size](std::size_t count)
+		{
+			for (std::size_t round = 0; round < std::max<std::size_t>(count / size, 1); ++round)
+			{
+				LuaTable filled;
+				for (std::size_t i = 0; i < size; ++i)
+					filled.Add(keys[i], static_cast<int>(i));
+				Bench::DoNotOptimize(filled);
+			}
+		}));
+
+		std::snprintf(label, sizeof(label), "lookup, %zu entries", size);
+		Bench::Run(label, iterations, [&keys, &table, size](std::size_t i)
+		{
+			int value = 0;
+			table.TryGet(keys[(i * 7919) % size], value); // spread over the table
+			Bench::DoNotOptimize(value);
+		});
+
+		std::snprintf(label, sizeof(label), "ForEach, %zu entries", size);
+		Bench::Print(label, Bench::MeasureBatch(iterations, [&table, size](std::size_t count)
+		{
+			long long sum = 0;
+			for (std::size_t round = 0; round < std::max<std::size_t>(count / size, 1); ++round)
+				table.ForEach([&sum](LuaValue const &, LuaValue const &value) { sum += value.AsInteger(); });
+			Bench::DoNotOptimize(sum);
+		}));
+	}
+}
@@ -0,0 +1,64 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+static void Parse(lua_State *L, const char *label, const char *source)
+{
+	luaL_dostring(L, source);
+	Bench::Run(label, 20000, [L](std::size_t)
+	{
+		LuaTable table;
+		table.ParseFromLua(L, 1);
+		Bench::DoNotOptimize(table);
+	});
+	lua_settop(L, 0);
+}
+
+static void Validate(lua_State *L, const char *label, const char *source)
+{
+	luaL_dostring(L, source);
+	Bench::Run(label, 20000, [L](std::size_t)
+	{
+		Bench::DoNotOptimize(LuaTable::ValidateLua(L, 1));
+	});
+	lua_settop(L, 0);
+}
+
+// LuaTable::ParseFromLua on a sequence, on records of different sizes and on a mixed table,
+// and the ValidateLua pass the argument converters run before it
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+
+	Bench::Section("LuaTable::ParseFromLua");
+	Parse(L, "500 element sequence", "local t = {} for i = 1, 500 do t[i] = i * 3 end return t");
+	Parse(L, "200 fields of {x, y, z}",
+		"local t = {} for i = 1, 200 do t['field' .. i] = { x = i, y = i, z = i } end return t");
+	Parse(L, "{ a = 1, b = 2, c = 'x' }", "return { a = 1, b = 2, c = 'x' }");
+	Parse(L, "1000 string keys", "local t = {} for i = 1, 1000 do t['key' .. i] = i end return t");
+	Parse(L, "100 element sequence and 100 string keys",
+		"local t = {} for i = 1, 100 do t[i] = i t['key' .. i] = i end return t");
+
+	Bench::Section("LuaTable::ValidateLua");
+	Validate(L, "500 element sequence", "local t = {} for i = 1, 500 do t[i] = i * 3 end return t");
+	Validate(L, "200 fields of {x, y, z}",
+		"local t = {} for i = 1, 200 do t['field' .. i] = { x = i, y = i, z = i } end return t");
+	Validate(L, "{ a = 1, b = 2, c = 'x' }", "return { a = 1, b = 2, c = 'x' }");
+	lua_close(L);
+}
@@ -0,0 +1,50 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+LUA_DEFINE(ReadCopied)
+{
+	LuaTable_t config;
+	ParseArguments(L, config);
+	int first = 0, last = 0;
+	config->TryGet("field1", first);
+	config->TryGet("field150", last);
+	return ReturnValues(L, first + last);
+}
+
+LUA_DEFINE(ReadReferenced)
+{
+	LuaTableRef config;
+	ParseArguments(L, config);
+	return ReturnValues(L, config.Get<int>("field1") + config.Get<int>("field150"));
+}
+
+// A native function reading 2 fields of a 200 field table passed from Lua
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	RegisterPluginFunction(L, "ReadCopied", ReadCopied);
+	RegisterPluginFunction(L, "ReadReferenced", ReadReferenced);
+	luaL_dostring(L, "config = {} for i = 1, 200 do config['field' .. i] = i end");
+
+	Bench::Section("reading 2 of 200 fields");
+	Bench::RunLua(L, "LuaTable_t", 100000, "local n = ... local f = ReadCopied for i = 1, n do f(config) end");
+	Bench::RunLua(L, "LuaTableRef", 100000, "local n = ... local f = ReadReferenced for i = 1, n do f(config) end");
+	lua_close(L);
+}
@@ -0,0 +1,105 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Benchmark.hpp"
+
+using namespace Lua;
+
+struct Vehicle
+{
+	int id = 0;
+	float health = 100.f;
+
+	float GetHealth() const
+	{
+		return health;
+	}
+};
+
+// a second type, to measure methods on a type that also has properties
+struct Truck : Vehicle
+{ };
+
+static std::unordered_map<int, Vehicle> vehicles;
+static Truck truck;
+
+static float GetVehicleHealth(int id)
+{
+	auto it = vehicles.find(id);
+	if (it == vehicles.end())
+		throw std::runtime_error("invalid vehicle");
+	return it->second.health;
+}
+
+static Vehicle *GetVehicle(int id)
+{
+	return &vehicles[id];
+}
+
+static Truck *GetTruck()
+{
+	return &truck;
+}
+
+static int Nop(lua_State *)
+{
+	return 0;
+}
+
+// Reading the health of a vehicle by id against methods and properties of a bound class
+int main()
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	for (int id = 1; id <= 1000; ++id)
+		vehicles[id] = Vehicle{ id };
+	RegisterPluginFunction<&GetVehicleHealth>(L, "GetVehicleHealth");
+	RegisterPluginFunction<&GetVehicle>(L, "GetVehicle");
+	RegisterPluginFunction<&GetTruck>(L, "GetTruck");
+	Usertype<Vehicle>(L, "Vehicle").Method<&Vehicle::GetHealth>("GetHealth");
+	Usertype<Truck>(L, "Truck").Method<&Vehicle::GetHealth>("GetHealth").Property<&Vehicle::health>("health");
+
+	// the same calls on a bare userdata, for the cost of the VM's __index lookup
+	lua_newuserdatauv(L, 16, 0);
+	lua_createtable(L, 0, 1);
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, &Nop);
+	lua_setfield(L, -2, "Nop");
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "bare");
+	lua_pushcfunction(L, &Nop);
+	lua_setglobal(L, "Nop");
+
+	Bench::Section("Usertype");
+	Bench::RunLua(L, "GetVehicleHealth(id), unordered_map lookup", 5000000,
+		"local n = ... local f = GetVehicleHealth for i = 1, n do f(500) end");
+	Bench::RunLua(L, "v:GetHealth()", 5000000,
+		"local n = ... local v = GetVehicle(500) for i = 1, n do v:GetHealth() end");
+	Bench::RunLua(L, "local m = v.GetHealth; m(v)", 5000000,
+		"local n = ... local v = GetVehicle(500) local m = v.GetHealth for i = 1, n do m(v) end");
+	Bench::RunLua(L, "v.health (property)", 5000000,
+		"local n = ... local v = GetTruck() for i = 1, n do local h = v.health end");
+	Bench::RunLua(L, "v:GetHealth() on a type with properties", 5000000,
+		"local n = ... local v = GetTruck() for i = 1, n do v:GetHealth() end");
+	Bench::RunLua(L, "Nop(), a bare C function", 5000000,
+		"local n = ... local f = Nop for i = 1, n do f(1) end");
+	Bench::RunLua(L, "u:Nop(), a bare C function on a userdata", 5000000,
+		"local n = ... local u = bare for i = 1, n do u:Nop() end");
+	lua_close(L);
+}
@@ -15,7 +15,7 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 #ifndef __PLUGINSDK_H
 #define __PLUGINSDK_H
 
-#define PLUGIN_API_VERSION 0x1
+#define PLUGIN_API_VERSION 0x2
 
 #ifdef _MSC_VER
 #define LIBRARY_EXPORT __declspec(dllexport)
@@ -49,14 +49,28 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 #endif
 
 #ifdef __cplusplus
+#include "sdk/LuaArena.hpp"
 #include "sdk/LuaFunctionUtils.hpp"
+#include "sdk/LuaBinding.hpp"
+#include "sdk/LuaUsertype.hpp"
 #include "sdk/LuaTable.hpp"
+#include "sdk/LuaTableRef.hpp"
 #include "sdk/LuaFunction.hpp"
 #include "sdk/LuaValueLuaImpl.hpp"
+#include "sdk/LuaEventBatch.hpp"
+#include "sdk/LuaArgsView.hpp"
 #include "sdk/PluginApi.hpp"
+#include "sdk/DeferredEventQueue.hpp"
 #endif
 
+#if defined(__cplusplus) && ONSET_SDK_CHECK_BORROWS
+// the body runs inside a Lua::BorrowScope so borrowed strings can be checked for use after return
+#define LUA_DEFINE(func) static int func##_Body(lua_State *L); \
+	static int func(lua_State *L) { Lua::BorrowScope borrow_scope; return func##_Body(L); } \
+	static int func##_Body(lua_State *L)
+#else
 #define LUA_DEFINE(func) static int func(lua_State *L)
+#endif
 #define LUA_FUNCTION(func) int func(lua_State *L)
 
 
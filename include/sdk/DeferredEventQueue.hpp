@@ -0,0 +1,252 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "LuaTypes.hpp"
+#include "PluginApi.hpp"
+
+namespace Onset
+{
+	// Events posted from any thread and called on the game thread, e.g. when a worker finished
+	//
+	//	static Onset::DeferredEventQueue events;
+	//	events.Attach(); // in OnPluginStart
+	//	...
+	//	std::thread([] { events.Post("OnPathFound", npc, LoadPath(npc)); }).detach();
+	//	...
+	//	events.Detach(); // in OnPluginStop
+	//
+	// An attached queue has to be detached in OnPluginStop, or before the plugin is stopped if
+	// it's destroyed earlier. The destructor of a static queue runs after the server is gone, it
+	// can't tell a stale server pointer from a live one.
+	//
+	// Once attached, the server drains the queue every frame after the packages' OnGameTick and
+	// calls the events in the order they were posted, until the budget of the frame is used up;
+	// the rest waits for the next frame. Posting never blocks: the queue is a lock-free linked
+	// list with many producers and the game thread as its only consumer.
+	//
+	// Arguments are copied into a LuaArgs_t when posting, so they may not refer to Lua values.
+	// LuaTables can be posted, but the posting thread must not touch them afterwards.
+	class DeferredEventQueue
+	{
+	private:
+		struct Node
+		{
+			std::atomic<Node *> next{ nullptr };
+		};
+
+		struct Entry : Node
+		{
+			std::string name;
+			Lua::LuaArgs_t arguments;
+			bool remote;
+
+			Entry(const char *event_name, Lua::LuaArgs_t &&args, bool is_remote) :
+				name(event_name),
+				arguments(std::move(args)),
+				remote(is_remote)
+			{ }
+		};
+
+		std::atomic<Node *> _head; // last posted, exchanged by producers
+		Node *_tail; // next to call, only touched by the game thread
+		Node _stub;
+		double _budget;
+		bool _attached = false;
+
+	public:
+		// budget_seconds is the time the events may take each frame, at least one event is called
+		explicit DeferredEventQueue(double budget_seconds = 0.001) :
+			_head(&_stub),
+			_tail(&_stub),
+			_budget(budget_seconds)
+		{ }
+		~DeferredEventQueue()
+		{
+			Detach();
+			while (Entry *entry = Pop())
+				delete entry;
+		}
+
+		DeferredEventQueue(DeferredEventQueue const &) = delete;
+		DeferredEventQueue &operator=(DeferredEventQueue const &) = delete;
+
+	public:
+		// Have the server drain the queue every frame, call from the game thread. Returns false
+		// if there's no server yet, i.e. before OnPluginStart.
+		bool Attach()
+		{
+			if (_attached)
+				return true;
+
+			if (Plugin::Get() == nullptr)
+				return false;
+
+			Plugin::Get()->AddDeferredEventQueue(&DrainFrame, this);
+			_attached = true;
+			return true;
+		}
+
+		// Stop draining, events still queued stay until the next Attach or Drain. Call from the
+		// game thread, at the latest in OnPluginStop.
+		void Detach()
+		{
+			if (!_attached)
+				return;
+
+			if (Plugin::Get() != nullptr)
+				Plugin::Get()->RemoveDeferredEventQueue(this);
+			_attached = false;
+		}
+
+		// game thread only, takes effect with the next frame
+		inline void SetBudget(double budget_seconds)
+		{
+			_budget = budget_seconds;
+		}
+
+		inline double GetBudget() const
+		{
+			return _budget;
+		}
+
+		// Queue IServerPlugin::CallEvent(event_name, args), callable from any thread
+		template<typename... Args>
+		inline void Post(const char *event_name, Args&&... args)
+		{
+			Push(new Entry(event_name, MakeArguments(std::forward<Args>(args)...), false));
+		}
+
+		// Queue IServerPlugin::CallRemoteEvent(event_name, args), callable from any thread
+		template<typename... Args>
+		inline void PostRemote(const char *event_name, Args&&... args)
+		{
+			Push(new Entry(event_name, MakeArguments(std::forward<Args>(args)...), true));
+		}
+
+		// Call queued events on the game thread until budget_seconds have passed. Returns the
+		// number of events called, none without a server. Done by the server every frame once
+		// attached.
+		std::size_t Drain(double budget_seconds)
+		{
+			IServerPlugin *server = Plugin::Get();
+			if (server == nullptr)
+				return 0;
+
+			using Clock = std::chrono::steady_clock;
+			const Clock::time_point deadline = Clock::now()
+				+ std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget_seconds));
+
+			std::size_t count = 0;
+			while (Entry *entry = Pop())
+			{
+				if (entry->remote)
+					server->CallRemoteEvent(entry->name.c_str(), &entry->arguments);
+				else
+					server->CallEvent(entry->name.c_str(), &entry->arguments);
+				delete entry;
+				++count;
+
+				if (Clock::now() >= deadline)
+					break;
+			}
+			return count;
+		}
+
+		inline std::size_t Drain()
+		{
+			return Drain(_budget);
+		}
+
+	private:
+		// A single LuaArgs_t is taken as the argument list. Values are always copied: a moved
+		// LuaValue keeps strings which live in an arena or on the Lua stack, a copy owns them.
+		template<typename... Args>
+		static Lua::LuaArgs_t MakeArguments(Args&&... args)
+		{
+			if constexpr (sizeof...(Args) == 1 && (std::is_same<std::decay_t<Args>, Lua::LuaArgs_t>::value && ...))
+			{
+				Lua::LuaArgs_t arguments(std::forward<Args>(args)...);
+				if constexpr ((std::is_rvalue_reference<Args &&>::value && ...))
+				{
+					// the vector was moved, its values still have to be copied
+					for (Lua::LuaValue &value : arguments)
+						value = Lua::LuaValue(std::as_const(value));
+				}
+				return arguments;
+			}
+			else
+			{
+				Lua::LuaArgs_t arguments;
+				arguments.reserve(sizeof...(Args));
+				(arguments.emplace_back(std::as_const(args)), ...);
+				return arguments;
+			}
+		}
+
+		static std::size_t DrainFrame(void *context)
+		{
+			return static_cast<DeferredEventQueue *>(context)->Drain();
+		}
+
+		void Push(Node *node)
+		{
+			node->next.store(nullptr, std::memory_order_relaxed);
+			Node *prev = _head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release); // until here the node is unreachable
+		}
+
+		// the oldest entry, or nullptr if empty or the next post isn't linked in yet
+		Entry *Pop()
+		{
+			Node *tail = _tail;
+			Node *next = tail->next.load(std::memory_order_acquire);
+			if (tail == &_stub)
+			{
+				if (next == nullptr)
+					return nullptr;
+
+				_tail = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if (next != nullptr)
+			{
+				_tail = next;
+				return static_cast<Entry *>(tail);
+			}
+
+			if (tail != _head.load(std::memory_order_acquire))
+				return nullptr; // a producer is between exchange and link, get it next frame
+
+			// tail is the last entry, put the stub behind it so it can be taken
+			Push(&_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				return nullptr;
+
+			_tail = next;
+			return static_cast<Entry *>(tail);
+		}
+	};
+}
@@ -0,0 +1,526 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ONSET_SDK_FLAT_HASH_SSE2 1
+#else
+#define ONSET_SDK_FLAT_HASH_SSE2 0
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace Lua
+{
+	// A group of control bytes which is probed at once. Full slots store the low 7 bits of
+	// their hash, free slots are Empty or Deleted, both negative.
+	class FlatHashGroup
+	{
+	public:
+		static constexpr signed char Empty = -128;
+		static constexpr signed char Deleted = -2;
+
+#if ONSET_SDK_FLAT_HASH_SSE2
+		static constexpr std::size_t Width = 16;
+
+	private:
+		__m128i _ctrl;
+
+	public:
+		explicit FlatHashGroup(const signed char *ctrl) :
+			_ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl)))
+		{ }
+
+		inline std::uint32_t Match(signed char h2) const
+		{
+			return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl)));
+		}
+
+		inline std::uint32_t MatchFree() const
+		{
+			return static_cast<std::uint32_t>(_mm_movemask_epi8(_ctrl));
+		}
+
+		inline std::uint32_t MatchFull() const
+		{
+			return MatchFree() ^ 0xFFFF;
+		}
+#else
+		static constexpr std::size_t Width = 8;
+
+	private:
+		signed char _ctrl[Width];
+
+	public:
+		explicit FlatHashGroup(const signed char *ctrl)
+		{
+			std::memcpy(_ctrl, ctrl, Width);
+		}
+
+		inline std::uint32_t Match(signed char h2) const
+		{
+			std::uint32_t mask = 0;
+			for (std::size_t i = 0; i < Width; ++i)
+				mask |= static_cast<std::uint32_t>(_ctrl[i] == h2) << i;
+			return mask;
+		}
+
+		inline std::uint32_t MatchFree() const
+		{
+			std::uint32_t mask = 0;
+			for (std::size_t i = 0; i < Width; ++i)
+				mask |= static_cast<std::uint32_t>(_ctrl[i] < 0) << i;
+			return mask;
+		}
+
+		inline std::uint32_t MatchFull() const
+		{
+			return MatchFree() ^ 0xFF;
+		}
+#endif
+
+		inline std::uint32_t MatchEmpty() const
+		{
+			return Match(Empty);
+		}
+
+		static inline std::size_t LowestBit(std::uint32_t mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return static_cast<std::size_t>(__builtin_ctz(mask));
+#endif
+		}
+	};
+
+	// Open addressing hash map with contiguous slots, probed one group of control bytes at a
+	// time (SSE2 where available). Rehashing moves entries, pointers into the map are only
+	// stable until the next insertion.
+	template<typename Key, typename Value, typename Hash = std::hash<Key>,
+		typename KeyEqual = std::equal_to<Key>>
+	class FlatHashMap
+	{
+	public:
+		struct Slot
+		{
+			Key first;
+			Value second;
+		};
+
+	private:
+		static constexpr std::size_t Width = FlatHashGroup::Width;
+
+		signed char *_ctrl = nullptr; // _capacity + Width bytes, the tail mirrors the first group
+		Slot *_slots = nullptr;
+		std::size_t _capacity = 0; // 0 or a power of two >= Width
+		std::size_t _size = 0;
+		std::size_t _growth_left = 0;
+		std::pmr::memory_resource *_resource = nullptr; // nullptr for the global heap
+
+	public:
+		FlatHashMap() = default;
+		explicit FlatHashMap(std::pmr::memory_resource *resource) :
+			_resource(resource)
+		{ }
+		// copies always allocate from the global heap
+		FlatHashMap(FlatHashMap const &rhs)
+		{
+			if (rhs._size == 0)
+				return;
+
+			Allocate(rhs._capacity);
+			std::memcpy(_ctrl, rhs._ctrl, _capacity + Width);
+			for (std::size_t i = 0; i < _capacity; ++i)
+			{
+				if (_ctrl[i] >= 0)
+					new(&_slots[i]) Slot(rhs._slots[i]);
+			}
+			_size = rhs._size;
+			_growth_left = rhs._growth_left;
+		}
+		FlatHashMap(FlatHashMap &&rhs) noexcept
+		{
+			Swap(rhs);
+		}
+		FlatHashMap &operator=(FlatHashMap const &rhs)
+		{
+			if (this != &rhs)
+				FlatHashMap(rhs).Swap(*this);
+			return *this;
+		}
+		FlatHashMap &operator=(FlatHashMap &&rhs) noexcept
+		{
+			FlatHashMap(std::move(rhs)).Swap(*this);
+			return *this;
+		}
+		~FlatHashMap()
+		{
+			DestroySlots();
+			Deallocate();
+		}
+
+	public:
+		inline std::size_t Size() const
+		{
+			return _size;
+		}
+
+		inline std::size_t Capacity() const
+		{
+			return _capacity;
+		}
+
+		// whether the next new key rehashes into a larger table; false before the first insertion
+		inline bool IsFull() const
+		{
+			return _capacity != 0 && _growth_left == 0;
+		}
+
+		inline void Swap(FlatHashMap &rhs) noexcept
+		{
+			std::swap(_ctrl, rhs._ctrl);
+			std::swap(_slots, rhs._slots);
+			std::swap(_capacity, rhs._capacity);
+			std::swap(_size, rhs._size);
+			std::swap(_growth_left, rhs._growth_left);
+			std::swap(_resource, rhs._resource);
+		}
+
+		// makes room for count entries without rehashing
+		void Reserve(std::size_t count)
+		{
+			if (count <= _size + _growth_left)
+				return;
+
+			std::size_t capacity = Width;
+			while (MaxLoad(capacity) < count)
+				capacity *= 2;
+			Rehash(capacity);
+		}
+
+		void Clear()
+		{
+			if (_size == 0)
+				return;
+
+			DestroySlots();
+			std::memset(_ctrl, FlatHashGroup::Empty, _capacity + Width);
+			_size = 0;
+			_growth_left = MaxLoad(_capacity);
+		}
+
+		Slot *Find(Key const &key) const
+		{
+			if (_size == 0)
+				return nullptr;
+
+			std::size_t hash = Mix(Hash()(key));
+			std::size_t mask = _capacity - 1;
+			std::size_t pos = (hash >> 7) & mask;
+			for (std::size_t step = Width; ; step += Width)
+			{
+				FlatHashGroup group(_ctrl + pos);
+				for (std::uint32_t match = group.Match(H2(hash)); match != 0; match &= match - 1)
+				{
+					std::size_t index = (pos + FlatHashGroup::LowestBit(match)) & mask;
+					if (KeyEqual()(_slots[index].first, key))
+						return &_slots[index];
+				}
+				if (group.MatchEmpty() != 0)
+					return nullptr;
+				pos = (pos + step) & mask;
+			}
+		}
+
+		// returns the slot for key, second is true if it was inserted with a default value
+		std::pair<Slot *, bool> FindOrInsert(Key key)
+		{
+			if (Slot *slot = Find(key))
+				return { slot, false };
+
+			return { InsertNew(std::move(key), Value()), true };
+		}
+
+		// inserts without looking for an existing entry, the key must not be in the map yet
+		Slot *InsertUnique(Key key, Value value)
+		{
+			return InsertNew(std::move(key), std::move(value));
+		}
+
+		bool Erase(Key const &key)
+		{
+			Slot *slot = Find(key);
+			if (slot == nullptr)
+				return false;
+
+			slot->~Slot();
+			SetCtrl(static_cast<std::size_t>(slot - _slots), FlatHashGroup::Deleted);
+			--_size;
+			return true;
+		}
+
+		template<typename F>
+		void ForEach(F &&func) const
+		{
+			for (std::size_t pos = 0; pos < _capacity; pos += Width)
+			{
+				for (std::uint32_t match = FlatHashGroup(_ctrl + pos).MatchFull(); match != 0; match &= match - 1)
+				{
+					Slot const &slot = _slots[pos + FlatHashGroup::LowestBit(match)];
+					func(slot.first, slot.second);
+				}
+			}
+		}
+
+		// stops as soon as func returns false, returns false in that case
+		template<typename F>
+		bool ForEachWhile(F &&func) const
+		{
+			for (std::size_t pos = 0; pos < _capacity; pos += Width)
+			{
+				for (std::uint32_t match = FlatHashGroup(_ctrl + pos).MatchFull(); match != 0; match &= match - 1)
+				{
+					Slot const &slot = _slots[pos + FlatHashGroup::LowestBit(match)];
+					if (!func(slot.first, slot.second))
+						return false;
+				}
+			}
+			return true;
+		}
+
+		// forward iterator over the full slots, invalidated by any insertion or erasure
+		class ConstIterator
+		{
+		private:
+			const signed char *_ctrl = nullptr; // start of the current group
+			const Slot *_group = nullptr; // first slot of the current group
+			const Slot *_end = nullptr;
+			std::uint32_t _match = 0; // full slots of the current group not visited yet
+
+		public:
+			ConstIterator() = default;
+			ConstIterator(const signed char *ctrl, const Slot *group, const Slot *end) :
+				_ctrl(ctrl),
+				_group(group),
+				_end(end)
+			{
+				if (_group != _end)
+				{
+					_match = FlatHashGroup(_ctrl).MatchFull();
+					NextGroup();
+				}
+			}
+
+		public:
+			inline Slot const &operator*() const
+			{
+				return _group[FlatHashGroup::LowestBit(_match)];
+			}
+
+			inline const Slot *operator->() const
+			{
+				return &**this;
+			}
+
+			inline ConstIterator &operator++()
+			{
+				_match &= _match - 1;
+				NextGroup();
+				return *this;
+			}
+
+			inline bool operator==(ConstIterator const &rhs) const
+			{
+				return _group == rhs._group && _match == rhs._match;
+			}
+
+			inline bool operator!=(ConstIterator const &rhs) const
+			{
+				return !(*this == rhs);
+			}
+
+		private:
+			// the capacity is a multiple of the group width, groups never cross the end
+			inline void NextGroup()
+			{
+				while (_match == 0)
+				{
+					_ctrl += Width;
+					_group += Width;
+					if (_group == _end)
+						return;
+					_match = FlatHashGroup(_ctrl).MatchFull();
+				}
+			}
+		};
+
+		inline ConstIterator begin() const
+		{
+			return ConstIterator(_ctrl, _slots, _slots + _capacity);
+		}
+
+		inline ConstIterator end() const
+		{
+			const Slot *end = _slots + _capacity;
+			return ConstIterator(nullptr, end, end);
+		}
+
+	private:
+		static inline std::size_t MaxLoad(std::size_t capacity)
+		{
+			return capacity - capacity / 8;
+		}
+
+		// spreads weak hashes (std::hash of an integer is the identity) over all bits
+		static inline std::size_t Mix(std::size_t hash)
+		{
+			std::uint64_t mixed = static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+			return static_cast<std::size_t>(mixed ^ (mixed >> 32));
+		}
+
+		static inline signed char H2(std::size_t hash)
+		{
+			return static_cast<signed char>(hash & 0x7F);
+		}
+
+		inline void SetCtrl(std::size_t index, signed char value)
+		{
+			_ctrl[index] = value;
+			if (index < Width)
+				_ctrl[_capacity + index] = value;
+		}
+
+		Slot *InsertNew(Key &&key, Value &&value)
+		{
+			std::size_t hash = Mix(Hash()(key));
+			std::size_t index = FindFree(hash);
+			if (_growth_left == 0 && (_capacity == 0 || _ctrl[index] == FlatHashGroup::Empty))
+			{
+				// rehash in place to drop tombstones while mostly deleted, grow otherwise
+				Rehash(_size * 2 + 1 > MaxLoad(_capacity) ? (_capacity == 0 ? Width : _capacity * 2) : _capacity);
+				index = FindFree(hash);
+			}
+
+			if (_ctrl[index] == FlatHashGroup::Empty)
+				--_growth_left;
+			SetCtrl(index, H2(hash));
+			new(&_slots[index]) Slot{ std::move(key), std::move(value) };
+			++_size;
+			return &_slots[index];
+		}
+
+		// first empty or deleted slot on the probe sequence of hash, the map must not be full
+		std::size_t FindFree(std::size_t hash) const
+		{
+			if (_capacity == 0)
+				return 0;
+
+			std::size_t mask = _capacity - 1;
+			std::size_t pos = (hash >> 7) & mask;
+			for (std::size_t step = Width; ; step += Width)
+			{
+				std::uint32_t match = FlatHashGroup(_ctrl + pos).MatchFree();
+				if (match != 0)
+					return (pos + FlatHashGroup::LowestBit(match)) & mask;
+				pos = (pos + step) & mask;
+			}
+		}
+
+		void Allocate(std::size_t capacity)
+		{
+			static_assert(alignof(Slot) <= alignof(std::max_align_t), "over-aligned slots are not supported");
+
+			std::size_t ctrl_size = CtrlSize(capacity);
+			std::size_t size = ctrl_size + capacity * sizeof(Slot);
+			char *memory = static_cast<char *>(_resource != nullptr
+				? _resource->allocate(size, alignof(std::max_align_t)) : ::operator new(size));
+			_ctrl = reinterpret_cast<signed char *>(memory);
+			_slots = reinterpret_cast<Slot *>(memory + ctrl_size);
+			_capacity = capacity;
+			std::memset(_ctrl, FlatHashGroup::Empty, capacity + Width);
+		}
+
+		void Deallocate()
+		{
+			FreeBlock(_ctrl, _capacity);
+			_ctrl = nullptr;
+			_slots = nullptr;
+			_capacity = 0;
+		}
+
+		static inline std::size_t CtrlSize(std::size_t capacity)
+		{
+			return (capacity + Width + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+		}
+
+		void FreeBlock(signed char *ctrl, std::size_t capacity)
+		{
+			if (ctrl == nullptr)
+				return;
+
+			if (_resource != nullptr)
+				_resource->deallocate(ctrl, CtrlSize(capacity) + capacity * sizeof(Slot), alignof(std::max_align_t));
+			else
+				::operator delete(ctrl);
+		}
+
+		void DestroySlots()
+		{
+			for (std::size_t i = 0; i < _capacity; ++i)
+			{
+				if (_ctrl[i] >= 0)
+					_slots[i].~Slot();
+			}
+		}
+
+		void Rehash(std::size_t capacity)
+		{
+			signed char *old_ctrl = _ctrl;
+			Slot *old_slots = _slots;
+			std::size_t old_capacity = _capacity;
+
+			Allocate(capacity);
+			for (std::size_t i = 0; i < old_capacity; ++i)
+			{
+				if (old_ctrl[i] < 0)
+					continue;
+
+				std::size_t hash = Mix(Hash()(old_slots[i].first));
+				std::size_t index = FindFree(hash);
+				SetCtrl(index, H2(hash));
+				new(&_slots[index]) Slot(std::move(old_slots[i]));
+				old_slots[i].~Slot();
+			}
+			_growth_left = MaxLoad(_capacity) - _size;
+
+			FreeBlock(old_ctrl, old_capacity);
+		}
+	};
+}
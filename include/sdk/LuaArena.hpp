@@ -0,0 +1,59 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+
+namespace Lua
+{
+	// Monotonic allocator for transient values, e.g. the arguments of one call or everything
+	// converted during one server tick. Freeing is a no-op, Reset() releases all memory at once.
+	//
+	// Values allocated from an arena (pmr::LuaArgs_t, LuaTable::Create(arena.Resource()) and
+	// the strings and tables parsed into them) must be destroyed before Reset() and must not be
+	// stored beyond it. Copies of strings are taken from the global heap, tables are shared by
+	// handle and have to be copied element-wise to be kept. An arena is not thread-safe.
+	class Arena
+	{
+	private:
+		std::unique_ptr<unsigned char[]> _buffer; // reused after every reset
+		std::pmr::monotonic_buffer_resource _resource;
+
+	public:
+		// allocations beyond initial_size take further blocks from the global heap
+		explicit Arena(std::size_t initial_size = 64 * 1024) :
+			_buffer(new unsigned char[initial_size]),
+			_resource(_buffer.get(), initial_size)
+		{ }
+
+		Arena(Arena const &) = delete;
+		Arena &operator=(Arena const &) = delete;
+
+	public:
+		inline std::pmr::memory_resource *Resource()
+		{
+			return &_resource;
+		}
+
+		// frees everything allocated since the last reset, keeps the initial block
+		inline void Reset()
+		{
+			_resource.release();
+		}
+	};
+}
@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include "LuaValue.hpp"
+#include "LuaTableRef.hpp"
+#include "LuaConverter.hpp"
+
+
+namespace Lua
+{
+	// Refers to a range of values on the Lua stack without converting them, e.g. the arguments
+	// of an event passed to a native listener. Indexes start at 0 like in LuaArgs_t. Only valid
+	// during the call it was passed to, borrowed strings and table views as well.
+	class LuaArgsView
+	{
+	private:
+		lua_State *_state;
+		int _first; // absolute stack index
+		int _count;
+
+	public:
+		LuaArgsView(lua_State *state, int first, int count) :
+			_state(state),
+			_first(lua_absindex(state, first)),
+			_count(count)
+		{ }
+
+	public:
+		inline lua_State *GetState() const
+		{
+			return _state;
+		}
+
+		inline int Size() const
+		{
+			return _count;
+		}
+
+		inline bool IsEmpty() const
+		{
+			return _count == 0;
+		}
+
+		// the lua_type() of the value at index, LUA_TNONE past the end
+		inline int GetType(int index) const
+		{
+			return IsInRange(index) ? lua_type(_state, _first + index) : LUA_TNONE;
+		}
+
+		// converts the value at index with its Converter, false if it's missing or of a different
+		// type. A std::string_view is borrowed from the stack.
+		template<typename T>
+		bool TryGet(int index, T &dest) const
+		{
+			if (!IsInRange(index) || !Converter<T>::Check(_state, _first + index))
+				return false;
+
+			dest = Converter<T>::Get(_state, _first + index);
+			return true;
+		}
+
+		template<typename T>
+		T Get(int index) const
+		{
+			T value{};
+			TryGet(index, value);
+			return value;
+		}
+
+		// the value at index with strings borrowed from the stack
+		inline LuaValue BorrowValue(int index) const
+		{
+			return IsInRange(index) ? BorrowValueFromLua(_state, _first + index) : LuaValue();
+		}
+
+		// a stack view of the table at index, invalid if it isn't a table
+		inline LuaTableRef GetTable(int index) const
+		{
+			if (GetType(index) != LUA_TTABLE)
+				return LuaTableRef();
+			return LuaTableRef(_state, _first + index);
+		}
+
+		// copies all values, e.g. to keep them beyond the call
+		LuaArgs_t Materialize() const
+		{
+			LuaArgs_t values;
+			values.reserve(_count);
+			for (int i = 0; i < _count; ++i)
+				values.push_back(ParseValueFromLua(_state, _first + i));
+			return values;
+		}
+
+		// pushes the value at index, nil past the end
+		inline void PushValue(int index) const
+		{
+			if (IsInRange(index))
+				lua_pushvalue(_state, _first + index);
+			else
+				lua_pushnil(_state);
+		}
+
+	private:
+		inline bool IsInRange(int index) const
+		{
+			return index >= 0 && index < _count;
+		}
+	};
+}
@@ -0,0 +1,460 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <new>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "LuaFunctionUtils.hpp"
+
+
+namespace Lua
+{
+	// Result and parameter types of a function, function pointer or call operator
+	template<typename T>
+	struct FunctionTraits : FunctionTraits<decltype(&T::operator())> { };
+
+	template<typename R, typename... A>
+	struct FunctionTraits<R(A...)>
+	{
+		using Result = R;
+		using Arguments = std::tuple<A...>;
+	};
+
+	template<typename R, typename... A>
+	struct FunctionTraits<R(A...) noexcept> : FunctionTraits<R(A...)> { };
+	template<typename R, typename... A>
+	struct FunctionTraits<R(*)(A...)> : FunctionTraits<R(A...)> { };
+	template<typename R, typename... A>
+	struct FunctionTraits<R(*)(A...) noexcept> : FunctionTraits<R(A...)> { };
+	template<typename C, typename R, typename... A>
+	struct FunctionTraits<R(C::*)(A...)> : FunctionTraits<R(A...)> { };
+	template<typename C, typename R, typename... A>
+	struct FunctionTraits<R(C::*)(A...) const> : FunctionTraits<R(A...)> { };
+	template<typename C, typename R, typename... A>
+	struct FunctionTraits<R(C::*)(A...) noexcept> : FunctionTraits<R(A...)> { };
+	template<typename C, typename R, typename... A>
+	struct FunctionTraits<R(C::*)(A...) const noexcept> : FunctionTraits<R(A...)> { };
+
+	// pushes a result, a std::tuple is returned as multiple values
+	template<typename T>
+	int ReturnResult(lua_State *state, T &&value)
+	{
+		return ReturnValues(state, std::forward<T>(value));
+	}
+
+	template<typename... T>
+	int ReturnResult(lua_State *state, std::tuple<T...> &&values)
+	{
+		return std::apply([state](auto&&... value)
+		{
+			return ReturnValues(state, std::forward<decltype(value)>(value)...);
+		}, std::move(values));
+	}
+
+	template<typename T>
+	struct IsArgumentList : std::integral_constant<bool, std::is_same<T, LuaArgs_t>::value
+		|| std::is_same<T, pmr::LuaArgs_t>::value> { };
+
+	// Raises the argument error ParseArguments would, or that of a nested value which doesn't
+	// convert. A trailing argument list checks every remaining argument as a LuaValue.
+	template<typename T>
+	inline void CheckArgument(lua_State *state, int index)
+	{
+		if constexpr (IsArgumentList<T>::value)
+		{
+			for (int top = lua_gettop(state); index <= top; ++index)
+				CheckArgument<LuaValue>(state, index);
+		}
+		else
+		{
+			if (!Converter<T>::Check(state, index))
+				luaL_argerror(state, index, ExpectedOf<T>(state));
+			ValidateValue<T>(state, index);
+		}
+	}
+
+	// converts an argument which passed CheckArgument without checking it again
+	template<int Index, typename T>
+	T GetArgument(lua_State *state)
+	{
+		if constexpr (IsArgumentList<T>::value)
+		{
+			T list;
+			ParseArguments<Index>(state, list);
+			return list;
+		}
+		else
+		{
+			return BuildValue<T>(state, Index);
+		}
+	}
+
+	// Converts the arguments of func, calls it and returns its results. Parameters are taken by
+	// value, reference or const reference of any type with a Converter, std::optional ones may
+	// be omitted, a trailing LuaArgs_t receives the remaining arguments. The first parameter is
+	// taken from stack index Start.
+	// Every argument is checked before the first one is converted: Lua errors longjmp past C++
+	// destructors, so none may be raised while a converted argument is alive.
+	template<int Start, typename R, typename... A, typename F, std::size_t... I>
+	int InvokeNative(lua_State *state, F &func, std::tuple<A...> *, std::index_sequence<I...>)
+	{
+		(void)state; // unused without parameters
+		(CheckArgument<typename std::decay<A>::type>(state, Start + static_cast<int>(I)), ...);
+
+		BorrowScope borrow_scope; // like LUA_DEFINE, for checking string_view arguments
+		std::tuple<typename std::decay<A>::type...> args{
+			GetArgument<Start + static_cast<int>(I), typename std::decay<A>::type>(state)... };
+		if constexpr (std::is_void<R>::value)
+		{
+			func(static_cast<A&&>(std::get<I>(args))...);
+			return 0;
+		}
+		else
+		{
+			return ReturnResult(state, func(static_cast<A&&>(std::get<I>(args))...));
+		}
+	}
+
+	// Signature is what the parameters are deduced from, func itself may be generic
+	template<typename Signature, int Start = 1, typename F>
+	int InvokeNative(lua_State *state, F &func)
+	{
+		using Traits = FunctionTraits<Signature>;
+		using Arguments = typename Traits::Arguments;
+		return InvokeNative<Start, typename Traits::Result>(state, func, static_cast<Arguments *>(nullptr),
+			std::make_index_sequence<std::tuple_size<Arguments>::value>());
+	}
+
+	// C++ exceptions must not pass through the Lua library, they are raised as Lua errors
+	template<typename Signature, int Start = 1, typename F>
+	int CallNative(lua_State *state, F &func)
+	{
+		try
+		{
+			return InvokeNative<Signature, Start>(state, func);
+		}
+		catch (std::exception const &e)
+		{
+			lua_pushstring(state, e.what());
+		}
+		catch (...)
+		{
+			lua_pushliteral(state, "unknown C++ exception");
+		}
+		return lua_error(state); // outside of the handler, the exception is destroyed by now
+	}
+
+	// The lua_CFunction generated for Func, argument checks and conversions are expanded at
+	// compile time
+	template<auto Func>
+	int BoundFunction(lua_State *state)
+	{
+		auto func = Func;
+		return CallNative<decltype(Func)>(state, func);
+	}
+
+	// The parameters of one overload as seen by the dispatcher: how many arguments it takes and
+	// which Lua types each of them accepts, see ConverterTypes
+	template<typename Arguments>
+	struct OverloadSignature;
+
+	template<typename... A>
+	struct OverloadSignature<std::tuple<A...>>
+	{
+		using Parameters = std::tuple<typename std::decay<A>::type...>;
+
+		static constexpr int Count = static_cast<int>(sizeof...(A));
+		static constexpr bool IsList[] = { IsArgumentList<typename std::decay<A>::type>::value..., false };
+		static constexpr bool Variadic = Count > 0 && IsList[Count - 1];
+		static constexpr int Fixed = Variadic ? Count - 1 : Count;
+		static constexpr int Types[] = { ConverterTypes<typename std::decay<A>::type>::value..., 0 };
+
+		// trailing parameters accepting none may be left out
+		static constexpr int Min = []()
+		{
+			int min = Fixed;
+			while (min > 0 && (Types[min - 1] & TypeBit(LUA_TNONE)) != 0)
+				--min;
+			return min;
+		}();
+
+		// types holds TypeBit() of the first Fixed arguments
+		static inline bool Matches(lua_State *state, int count, int const *types)
+		{
+			if (count < Min || (!Variadic && count > Fixed))
+				return false;
+			return MatchParameters(state, types, std::make_index_sequence<Fixed>());
+		}
+
+		// appends e.g. "(number, string|nil, ...)"
+		static void Describe(lua_State *state, luaL_Buffer *buffer)
+		{
+			luaL_addchar(buffer, '(');
+			for (int i = 0; i < Fixed; ++i)
+			{
+				if (i > 0)
+					luaL_addstring(buffer, ", ");
+				if (Types[i] == 0)
+				{
+					luaL_addstring(buffer, "value");
+					continue;
+				}
+				bool first = true;
+				for (int j = LUA_TNIL + 1; j <= LUA_TTHREAD + 1; ++j)
+				{
+					int type = j <= LUA_TTHREAD ? j : LUA_TNIL; // nil last, as in "number|nil"
+					if ((Types[i] & TypeBit(type)) == 0)
+						continue;
+					if (!first)
+						luaL_addchar(buffer, '|');
+					luaL_addstring(buffer, lua_typename(state, type));
+					first = false;
+				}
+			}
+			if (Variadic)
+				luaL_addstring(buffer, Fixed > 0 ? ", ..." : "...");
+			luaL_addchar(buffer, ')');
+		}
+
+	private:
+		template<std::size_t... I>
+		static inline bool MatchParameters(lua_State *state, int const *types, std::index_sequence<I...>)
+		{
+			(void)state; // unused without parameters
+			(void)types;
+			return (MatchParameter<typename std::tuple_element<I, Parameters>::type>(state,
+				static_cast<int>(I) + 1, types[I]) && ...);
+		}
+
+		template<typename T>
+		static inline bool MatchParameter(lua_State *state, int index, int type)
+		{
+			if constexpr (ConverterTypes<T>::value != 0)
+				return (type & ConverterTypes<T>::value) != 0;
+			else
+				return Converter<T>::Check(state, index);
+		}
+	};
+
+	template<auto Func>
+	using OverloadOf = OverloadSignature<typename FunctionTraits<decltype(Func)>::Arguments>;
+
+	// The name is the first upvalue when the overloads were pushed with one, otherwise it's
+	// guessed from the call, which finds none under pcall.
+	template<auto... Funcs>
+	int OverloadError(lua_State *state, int count)
+	{
+		const char *name = lua_tostring(state, lua_upvalueindex(1));
+		lua_Debug debug;
+		if (name == nullptr && lua_getstack(state, 0, &debug) != 0 && lua_getinfo(state, "n", &debug) != 0)
+			name = debug.name;
+
+		luaL_Buffer buffer;
+		luaL_buffinit(state, &buffer);
+		luaL_addstring(&buffer, "bad arguments to '");
+		luaL_addstring(&buffer, name != nullptr ? name : "?");
+		luaL_addstring(&buffer, "' (");
+		for (int i = 1; i <= count; ++i)
+		{
+			if (i > 1)
+				luaL_addstring(&buffer, ", ");
+			luaL_addstring(&buffer, luaL_typename(state, i));
+		}
+		luaL_addstring(&buffer, "), candidates are:");
+		((luaL_addstring(&buffer, "\n\t"), OverloadOf<Funcs>::Describe(state, &buffer)), ...);
+		luaL_pushresult(&buffer);
+		return lua_error(state);
+	}
+
+	// Calls the first of Funcs whose signature matches the Lua types of the arguments. The types
+	// are read once, then each candidate costs an argument count and a few mask compares.
+	template<auto... Funcs>
+	int OverloadedFunction(lua_State *state)
+	{
+		static_assert(((!std::is_convertible<decltype(Funcs), lua_CFunction>::value) && ...),
+			"a lua_CFunction can't be overloaded, its parameters are unknown");
+
+		constexpr int max_fixed = std::max({ OverloadOf<Funcs>::Fixed... });
+		int count = lua_gettop(state);
+		int types[max_fixed + 1];
+		for (int i = 0; i < max_fixed; ++i)
+			types[i] = TypeBit(lua_type(state, i + 1));
+
+		int results = 0;
+		bool called = ((OverloadOf<Funcs>::Matches(state, count, types)
+			&& (results = BoundFunction<Funcs>(state), true)) || ...);
+		if (!called)
+			return OverloadError<Funcs...>(state, count);
+		return results;
+	}
+
+	// captureless lambdas can't be default constructed before C++20, so a copy is kept per type
+	template<typename F>
+	struct BoundLambda
+	{
+		static inline std::optional<F> instance;
+
+		static int Call(lua_State *state)
+		{
+			return CallNative<F>(state, *instance);
+		}
+	};
+
+	// Calls Method on the object in the first upvalue, a light userdata
+	template<auto Method, typename C>
+	int BoundMethod(lua_State *state)
+	{
+		C *object = static_cast<C *>(lua_touserdata(state, lua_upvalueindex(1)));
+		auto func = [object](auto&&... args) -> decltype(auto)
+		{
+			return std::invoke(Method, object, std::forward<decltype(args)>(args)...);
+		};
+		return CallNative<decltype(Method)>(state, func);
+	}
+
+	// A callable with state, kept inline in a userdata which is the first upvalue of its closure
+	template<typename F>
+	struct BoundClosure
+	{
+		static int Call(lua_State *state)
+		{
+			F &func = *static_cast<F *>(lua_touserdata(state, lua_upvalueindex(1)));
+			return CallNative<F>(state, func);
+		}
+
+		static int Destroy(lua_State *state)
+		{
+			static_cast<F *>(lua_touserdata(state, 1))->~F();
+			return 0;
+		}
+
+		// pushes the metatable with __gc, created once per state and type
+		static void PushMetatable(lua_State *state)
+		{
+			static const char key = 0;
+			if (lua_rawgetp(state, LUA_REGISTRYINDEX, &key) == LUA_TTABLE)
+				return;
+
+			lua_pop(state, 1);
+			lua_createtable(state, 0, 2);
+			lua_pushcfunction(state, &Destroy);
+			lua_setfield(state, -2, "__gc");
+			lua_pushboolean(state, 0);
+			lua_setfield(state, -2, "__metatable");
+			lua_pushvalue(state, -1);
+			lua_rawsetp(state, LUA_REGISTRYINDEX, &key);
+		}
+	};
+
+	// Pushes Func as a Lua function. With several functions, the one matching the Lua types of
+	// the arguments is called, checking them in order; overloads select on the exact type, e.g.
+	// a string doesn't match an int parameter.
+	template<auto Func, auto... Overloads>
+	void PushNativeFunction(lua_State *state)
+	{
+		if constexpr (sizeof...(Overloads) != 0)
+			lua_pushcfunction(state, (&OverloadedFunction<Func, Overloads...>));
+		else if constexpr (std::is_convertible<decltype(Func), lua_CFunction>::value)
+			lua_pushcfunction(state, static_cast<lua_CFunction>(Func));
+		else
+			lua_pushcfunction(state, &BoundFunction<Func>);
+	}
+
+	// As PushNativeFunction<Func, Overloads...>, errors name overloads which don't match name
+	template<auto Func, auto... Overloads>
+	void PushNamedFunction(lua_State *state, const char *name)
+	{
+		if constexpr (sizeof...(Overloads) != 0)
+		{
+			lua_pushstring(state, name);
+			lua_pushcclosure(state, (&OverloadedFunction<Func, Overloads...>), 1);
+		}
+		else
+		{
+			(void)name; // only overloads report it
+			PushNativeFunction<Func>(state);
+		}
+	}
+
+	// Pushes member function Method bound to object, which has to outlive the function
+	template<auto Method, typename C>
+	void PushNativeFunction(lua_State *state, C *object)
+	{
+		lua_pushlightuserdata(state, const_cast<typename std::remove_const<C>::type *>(object));
+		lua_pushcclosure(state, &BoundMethod<Method, C>, 1);
+	}
+
+	// Pushes a lambda or functor as a Lua function. Captured state is moved into a userdata and
+	// destroyed by the garbage collector, captureless lambdas need no upvalue.
+	template<typename F, typename std::enable_if<std::is_class<typename std::decay<F>::type>::value, int>::type = 0>
+	void PushNativeFunction(lua_State *state, F &&func)
+	{
+		using Callable = typename std::decay<F>::type;
+		if constexpr (std::is_convertible<Callable, lua_CFunction>::value)
+		{
+			lua_pushcfunction(state, static_cast<lua_CFunction>(func));
+		}
+		else if constexpr (std::is_empty<Callable>::value && std::is_trivially_copyable<Callable>::value)
+		{
+			BoundLambda<Callable>::instance.emplace(std::forward<F>(func));
+			lua_pushcfunction(state, &BoundLambda<Callable>::Call);
+		}
+		else
+		{
+			static_assert(alignof(Callable) <= alignof(void *), "over-aligned callables are not supported");
+
+			new (lua_newuserdatauv(state, sizeof(Callable), 0)) Callable(std::forward<F>(func));
+			if constexpr (!std::is_trivially_destructible<Callable>::value)
+			{
+				BoundClosure<Callable>::PushMetatable(state);
+				lua_setmetatable(state, -2);
+			}
+			lua_pushcclosure(state, &BoundClosure<Callable>::Call, 1);
+		}
+	}
+
+	// Registers Func as global function_name, e.g. RegisterPluginFunction<&MyFunc>(L, "MyFunc").
+	// A lua_CFunction is registered as is, several functions as overloads of one Lua function,
+	// e.g. RegisterPluginFunction<&SpawnAt, &SpawnAtVector>(L, "Spawn").
+	template<auto Func, auto... Overloads>
+	void RegisterPluginFunction(lua_State *state, const char *function_name)
+	{
+		PushNamedFunction<Func, Overloads...>(state, function_name);
+		lua_setglobal(state, function_name);
+	}
+
+	// Registers a member function, e.g. RegisterPluginFunction<&Game::Spawn>(L, "Spawn", &game)
+	template<auto Method, typename C>
+	void RegisterPluginFunction(lua_State *state, const char *function_name, C *object)
+	{
+		PushNativeFunction<Method>(state, object);
+		lua_setglobal(state, function_name);
+	}
+
+	// Registers a lambda or functor, e.g. RegisterPluginFunction(L, "Add", [](int a, int b) { return a + b; })
+	template<typename F, typename std::enable_if<std::is_class<typename std::decay<F>::type>::value, int>::type = 0>
+	void RegisterPluginFunction(lua_State *state, const char *function_name, F &&func)
+	{
+		PushNativeFunction(state, std::forward<F>(func));
+		lua_setglobal(state, function_name);
+	}
+}
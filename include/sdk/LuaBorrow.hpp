@@ -0,0 +1,137 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// Borrowed strings point into the Lua stack and are only valid while the native function that
+// parsed them is running. Debug builds verify this on every access.
+#ifndef ONSET_SDK_CHECK_BORROWS
+#ifdef NDEBUG
+#define ONSET_SDK_CHECK_BORROWS 0
+#else
+#define ONSET_SDK_CHECK_BORROWS 1
+#endif
+#endif
+
+
+namespace Lua
+{
+	// Marks the lifetime of a native function call, LUA_DEFINE opens one automatically when
+	// borrow checks are enabled. Does nothing otherwise.
+	class BorrowScope
+	{
+#if ONSET_SDK_CHECK_BORROWS
+	private:
+		static constexpr int MaxDepth = 256;
+
+		struct Frame
+		{
+			const void *address;
+			std::uint16_t id;
+		};
+
+		struct State
+		{
+			Frame frames[MaxDepth];
+			int depth = 0;
+			std::uint16_t last_id = 0;
+		};
+
+		static State &GetState()
+		{
+			thread_local State state;
+			return state;
+		}
+
+		// luaL_error longjmps past our destructor, drop every frame living at or below the
+		// given stack address since those can't be alive anymore (stacks grow downwards)
+		static void DropDeadFrames(State &state, const void *address)
+		{
+			while (state.depth > 0
+				&& (state.depth > MaxDepth || state.frames[state.depth - 1].address <= address))
+			{
+				--state.depth;
+			}
+		}
+
+	public:
+		BorrowScope()
+		{
+			State &state = GetState();
+			DropDeadFrames(state, this);
+			if (++state.last_id == 0)
+				state.last_id = 1; // 0 is reserved for values created outside a scope
+
+			if (state.depth < MaxDepth)
+				state.frames[state.depth] = { this, state.last_id };
+			++state.depth;
+		}
+		~BorrowScope()
+		{
+			State &state = GetState();
+			if (state.depth > 0)
+				--state.depth;
+		}
+
+		BorrowScope(BorrowScope const &) = delete;
+		BorrowScope &operator=(BorrowScope const &) = delete;
+
+	public:
+		// id of the innermost open scope, 0 if there is none
+		static std::uint16_t CurrentId()
+		{
+			State &state = GetState();
+			if (state.depth == 0 || state.depth > MaxDepth)
+				return 0;
+			return state.frames[state.depth - 1].id;
+		}
+
+		static void CheckAlive(std::uint16_t id)
+		{
+			if (id == 0)
+				return;
+
+			State &state = GetState();
+			int depth = state.depth < MaxDepth ? state.depth : MaxDepth;
+			for (int i = depth - 1; i >= 0; --i)
+			{
+				if (state.frames[i].id == id)
+					return;
+			}
+
+			std::fprintf(stderr, "Lua::BorrowScope: borrowed string used after its native function returned\n");
+			std::abort();
+		}
+#else
+	public:
+		BorrowScope() { } // not defaulted, a scope that does nothing would warn as unused
+
+		BorrowScope(BorrowScope const &) = delete;
+		BorrowScope &operator=(BorrowScope const &) = delete;
+
+	public:
+		static inline std::uint16_t CurrentId()
+		{
+			return 0;
+		}
+
+		static inline void CheckAlive(std::uint16_t)
+		{ }
+#endif
+	};
+}
@@ -0,0 +1,837 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "LuaValue.hpp"
+#include "LuaTable.hpp"
+#include "LuaTableRef.hpp"
+#include "LuaFunction.hpp"
+
+
+namespace Lua
+{
+	// Conversion of T from and to the Lua stack, used by ParseArguments, ParseOptionalArguments,
+	// ReturnValues and LuaFunction::Call. Plugins add their own types by specializing it:
+	//
+	//	template<>
+	//	struct Lua::Converter<Vector3>
+	//	{
+	//		static constexpr const char *Expected = "expected vector";
+	//		// optional, replaces Expected in errors if the text depends on the state, see ExpectedOf
+	//		static const char *GetExpected(lua_State *state);
+	//		// optional, the Lua types accepted when choosing between overloads, see TypeBit
+	//		static constexpr int LuaTypes = Lua::TypeBit(LUA_TTABLE);
+	//		// whether the value at index can be converted, must not raise an error
+	//		static bool Check(lua_State *state, int index);
+	//		// only called after Check succeeded
+	//		static Vector3 Get(lua_State *state, int index);
+	//		// returns the number of values pushed
+	//		static int Push(lua_State *state, Vector3 const &value);
+	//	};
+	//
+	// Lua errors longjmp past C++ destructors, so Get must not raise one while it holds objects
+	// with destructors. Converters of nested values, like the containers below, check them all in
+	// an additional Validate(state, index), which raises an error naming the first bad element,
+	// and do the conversion in Build(state, index), which assumes Validate passed. Get calls both.
+	//
+	// Enable allows partial specializations for a group of types, e.g. all enums.
+	template<typename T, typename Enable = void>
+	struct Converter;
+
+	// bit of a lua_type() result in a type mask, LUA_TNONE included
+	constexpr int TypeBit(int type)
+	{
+		return 1 << (type + 1);
+	}
+
+	// Converter<T>::LuaTypes, or 0 if the converter doesn't declare it and only Check can tell
+	template<typename T, typename = void>
+	struct ConverterTypes : std::integral_constant<int, 0> { };
+
+	template<typename T>
+	struct ConverterTypes<T, std::void_t<decltype(Converter<T>::LuaTypes)>> :
+		std::integral_constant<int, Converter<T>::LuaTypes> { };
+
+	// whether Converter<T> checks nested values in Validate and converts them in Build
+	template<typename T, typename = void>
+	struct HasValidate : std::false_type { };
+
+	template<typename T>
+	struct HasValidate<T, std::void_t<decltype(&Converter<T>::Validate)>> : std::true_type { };
+
+	// raises an error for nested values at index which don't convert, after Check passed
+	template<typename T>
+	inline void ValidateValue(lua_State *state, int index)
+	{
+		if constexpr (HasValidate<T>::value)
+			Converter<T>::Validate(state, index);
+		else
+			(void)state, (void)index; // unused
+	}
+
+	// converts a value which passed Check and ValidateValue, nothing is checked again
+	template<typename T>
+	inline T BuildValue(lua_State *state, int index)
+	{
+		if constexpr (HasValidate<T>::value)
+			return Converter<T>::Build(state, index);
+		else
+			return Converter<T>::Get(state, index);
+	}
+
+	// whether Converter<T> words its errors per state in GetExpected
+	template<typename T, typename = void>
+	struct HasGetExpected : std::false_type { };
+
+	template<typename T>
+	struct HasGetExpected<T, std::void_t<decltype(&Converter<T>::GetExpected)>> : std::true_type { };
+
+	// the expected type in an error about a value that isn't a T; the text may be owned by state
+	template<typename T>
+	inline const char *ExpectedOf(lua_State *state)
+	{
+		if constexpr (HasGetExpected<T>::value)
+			return Converter<T>::GetExpected(state);
+		else
+			return (void)state, Converter<T>::Expected; // state unused
+	}
+
+	// checks the element on top of the stack, raising an error naming it if it doesn't fit
+	template<typename T>
+	void CheckElement(lua_State *state, lua_Integer element)
+	{
+		if (!Converter<T>::Check(state, -1))
+		{
+			luaL_error(state, "bad element #%I (%s, got %s)", element, ExpectedOf<T>(state),
+				luaL_typename(state, -1));
+		}
+		ValidateValue<T>(state, -1);
+	}
+
+	template<typename T>
+	struct Converter<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+	{
+		static constexpr const char *Expected = "expected integer-like argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TNUMBER);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			int type = lua_type(state, index);
+			return type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING;
+		}
+
+		static inline T Get(lua_State *state, int index)
+		{
+			return static_cast<T>(lua_tointeger(state, index));
+		}
+
+		static inline int Push(lua_State *state, T value)
+		{
+			lua_pushinteger(state, static_cast<lua_Integer>(value));
+			return 1;
+		}
+	};
+
+	// enums are passed as their underlying integer
+	template<typename T>
+	struct Converter<T, typename std::enable_if<std::is_enum<T>::value>::type>
+	{
+		using Underlying = typename std::underlying_type<T>::type;
+
+		static constexpr const char *Expected = "expected integer-like argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TNUMBER);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return Converter<Underlying>::Check(state, index);
+		}
+
+		static inline T Get(lua_State *state, int index)
+		{
+			return static_cast<T>(Converter<Underlying>::Get(state, index));
+		}
+
+		static inline int Push(lua_State *state, T value)
+		{
+			return Converter<Underlying>::Push(state, static_cast<Underlying>(value));
+		}
+	};
+
+	template<typename T>
+	struct Converter<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+	{
+		static constexpr const char *Expected = "expected number argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TNUMBER);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			int type = lua_type(state, index);
+			return type == LUA_TNUMBER || type == LUA_TSTRING;
+		}
+
+		static inline T Get(lua_State *state, int index)
+		{
+			return static_cast<T>(lua_tonumber(state, index));
+		}
+
+		static inline int Push(lua_State *state, T value)
+		{
+			lua_pushnumber(state, static_cast<lua_Number>(value));
+			return 1;
+		}
+	};
+
+	template<>
+	struct Converter<bool>
+	{
+		static constexpr const char *Expected = "expected boolean-like argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TBOOLEAN);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			int type = lua_type(state, index);
+			return type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING;
+		}
+
+		static inline bool Get(lua_State *state, int index)
+		{
+			return lua_toboolean(state, index) != 0;
+		}
+
+		static inline int Push(lua_State *state, bool value)
+		{
+			lua_pushboolean(state, value);
+			return 1;
+		}
+	};
+
+	template<>
+	struct Converter<std::string>
+	{
+		static constexpr const char *Expected = "expected string-like argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TSTRING);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			int type = lua_type(state, index);
+			return type == LUA_TSTRING || type == LUA_TNUMBER;
+		}
+
+		static inline std::string Get(lua_State *state, int index)
+		{
+			size_t length = 0;
+			const char *str = lua_tolstring(state, index, &length);
+			return std::string(str, length);
+		}
+
+		static inline int Push(lua_State *state, std::string const &value)
+		{
+			lua_pushlstring(state, value.c_str(), value.length());
+			return 1;
+		}
+	};
+
+	// the view points into the Lua stack and is only valid until the native function returns
+	template<>
+	struct Converter<std::string_view>
+	{
+		static constexpr const char *Expected = "expected string-like argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TSTRING);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return Converter<std::string>::Check(state, index);
+		}
+
+		static inline std::string_view Get(lua_State *state, int index)
+		{
+			size_t length = 0;
+			const char *str = lua_tolstring(state, index, &length);
+			return std::string_view(str, length);
+		}
+
+		static inline int Push(lua_State *state, std::string_view value)
+		{
+			lua_pushlstring(state, value.data(), value.length());
+			return 1;
+		}
+	};
+
+	// Like std::string_view, the string is borrowed from the Lua stack and only valid until the
+	// calling native function returns. Lua strings are always terminated by a zero.
+	template<>
+	struct Converter<const char *>
+	{
+		static constexpr const char *Expected = "expected string-like argument";
+		static constexpr int LuaTypes = TypeBit(LUA_TSTRING);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return Converter<std::string>::Check(state, index);
+		}
+
+		static inline const char *Get(lua_State *state, int index)
+		{
+			return lua_tolstring(state, index, nullptr);
+		}
+
+		static inline int Push(lua_State *state, const char *value)
+		{
+			lua_pushstring(state, value); // pushes nil if value is nullptr
+			return 1;
+		}
+	};
+
+	// push-only, Lua strings mustn't be modified
+	template<>
+	struct Converter<char *>
+	{
+		static inline int Push(lua_State *state, const char *value)
+		{
+			return Converter<const char *>::Push(state, value);
+		}
+	};
+
+	template<>
+	struct Converter<std::nullptr_t>
+	{
+		static inline int Push(lua_State *state, std::nullptr_t)
+		{
+			lua_pushnil(state);
+			return 1;
+		}
+	};
+
+	// raises the error of a table which can't be converted, see LuaTable::ParseFromLua
+	inline void RaiseTableError(lua_State *state, int index, const char *error)
+	{
+		if (index > 0)
+			luaL_argerror(state, index, error);
+		luaL_error(state, "%s", error);
+	}
+
+	// raises the error converting the table at index would, before anything is allocated
+	inline void ValidateTable(lua_State *state, int index)
+	{
+		if (const char *error = LuaTable::ValidateLua(state, index))
+			RaiseTableError(state, index, error);
+	}
+
+	template<>
+	struct Converter<LuaValue>
+	{
+		static constexpr const char *Expected = "expected value";
+		static constexpr int LuaTypes = TypeBit(LUA_TNIL) | TypeBit(LUA_TBOOLEAN) | TypeBit(LUA_TNUMBER)
+			| TypeBit(LUA_TSTRING) | TypeBit(LUA_TTABLE) | TypeBit(LUA_TFUNCTION);
+
+		// the types ParseValueFromLua understands
+		static inline bool Check(lua_State *state, int index)
+		{
+			int type = lua_type(state, index);
+			return type != LUA_TNONE && type != LUA_TUSERDATA && type != LUA_TLIGHTUSERDATA
+				&& type != LUA_TTHREAD;
+		}
+
+		static inline void Validate(lua_State *state, int index)
+		{
+			if (lua_istable(state, index))
+				ValidateTable(state, index);
+		}
+
+		static inline LuaValue Build(lua_State *state, int index)
+		{
+			return ParseValueFromLua(state, index);
+		}
+
+		static inline LuaValue Get(lua_State *state, int index)
+		{
+			Validate(state, index);
+			return Build(state, index);
+		}
+
+		static inline int Push(lua_State *state, LuaValue const &value)
+		{
+			PushValueToLua(value, state);
+			return 1;
+		}
+	};
+
+	template<>
+	struct Converter<LuaTable_t>
+	{
+		static constexpr const char *Expected = "expected table";
+		static constexpr int LuaTypes = TypeBit(LUA_TTABLE);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_istable(state, index);
+		}
+
+		static inline void Validate(lua_State *state, int index)
+		{
+			ValidateTable(state, index);
+		}
+
+		static LuaTable_t Build(lua_State *state, int index)
+		{
+			LuaTable_t table(LuaTable::Create());
+			const char *error = nullptr;
+			if (!table->ParseFromLua(state, index, ParseLimits(), &error))
+			{
+				table.reset(); // neither error unwinds, and Validate already raises them
+				RaiseTableError(state, index, error);
+			}
+			return table;
+		}
+
+		static inline LuaTable_t Get(lua_State *state, int index)
+		{
+			Validate(state, index);
+			return Build(state, index);
+		}
+
+		static inline int Push(lua_State *state, LuaTable_t const &value)
+		{
+			if (value)
+				value->PushToLua(state);
+			else
+				lua_pushnil(state);
+			return 1;
+		}
+	};
+
+	// a view on a table argument, fields are converted when accessed
+	template<>
+	struct Converter<LuaTableRef>
+	{
+		static constexpr const char *Expected = "expected table";
+		static constexpr int LuaTypes = TypeBit(LUA_TTABLE);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_istable(state, index);
+		}
+
+		static inline LuaTableRef Get(lua_State *state, int index)
+		{
+			return LuaTableRef(state, index);
+		}
+
+		static inline int Push(lua_State *state, LuaTableRef const &value)
+		{
+			value.PushToLua(state);
+			return 1;
+		}
+	};
+
+	template<>
+	struct Converter<LuaFunction>
+	{
+		static constexpr const char *Expected = "expected function";
+		static constexpr int LuaTypes = TypeBit(LUA_TFUNCTION);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_isfunction(state, index);
+		}
+
+		static inline LuaFunction Get(lua_State *state, int index)
+		{
+			LuaFunction function;
+			function.ParseFromLua(state, index);
+			return function;
+		}
+
+		static inline int Push(lua_State *state, LuaFunction const &value)
+		{
+			value.PushToLua(state);
+			return 1;
+		}
+	};
+
+	template<>
+	struct Converter<LuaFunction_t>
+	{
+		static constexpr const char *Expected = "expected function";
+		static constexpr int LuaTypes = TypeBit(LUA_TFUNCTION);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_isfunction(state, index);
+		}
+
+		static inline LuaFunction_t Get(lua_State *state, int index)
+		{
+			LuaFunction_t function(new LuaFunction());
+			function->ParseFromLua(state, index);
+			return function;
+		}
+
+		static inline int Push(lua_State *state, LuaFunction_t const &value)
+		{
+			if (value)
+				value->PushToLua(state);
+			else
+				lua_pushnil(state);
+			return 1;
+		}
+	};
+
+	// argument lists are returned as multiple values, see ParseArguments for the other direction
+	template<>
+	struct Converter<LuaArgs_t>
+	{
+		static int Push(lua_State *state, LuaArgs_t const &value)
+		{
+			for (auto const &e : value)
+				PushValueToLua(e, state);
+			return static_cast<int>(value.size());
+		}
+	};
+
+	template<>
+	struct Converter<pmr::LuaArgs_t>
+	{
+		static int Push(lua_State *state, pmr::LuaArgs_t const &value)
+		{
+			for (auto const &e : value)
+				PushValueToLua(e, state);
+			return static_cast<int>(value.size());
+		}
+	};
+
+	// nil or none is std::nullopt, which makes the parameter optional
+	template<typename T>
+	struct Converter<std::optional<T>>
+	{
+		static constexpr const char *Expected = Converter<T>::Expected;
+		static constexpr int LuaTypes = ConverterTypes<T>::value != 0
+			? ConverterTypes<T>::value | TypeBit(LUA_TNIL) | TypeBit(LUA_TNONE) : 0;
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_isnoneornil(state, index) || Converter<T>::Check(state, index);
+		}
+
+		static inline const char *GetExpected(lua_State *state)
+		{
+			return ExpectedOf<T>(state);
+		}
+
+		static inline void Validate(lua_State *state, int index)
+		{
+			if (!lua_isnoneornil(state, index))
+				ValidateValue<T>(state, index);
+		}
+
+		static inline std::optional<T> Get(lua_State *state, int index)
+		{
+			if (lua_isnoneornil(state, index))
+				return std::nullopt;
+			return Converter<T>::Get(state, index);
+		}
+
+		static inline std::optional<T> Build(lua_State *state, int index)
+		{
+			if (lua_isnoneornil(state, index))
+				return std::nullopt;
+			return BuildValue<T>(state, index);
+		}
+
+		static inline int Push(lua_State *state, std::optional<T> const &value)
+		{
+			if (!value)
+			{
+				lua_pushnil(state);
+				return 1;
+			}
+			return Converter<T>::Push(state, *value);
+		}
+	};
+
+	// a sequence {v1, v2, ...}
+	template<typename T, typename A>
+	struct Converter<std::vector<T, A>>
+	{
+		static constexpr const char *Expected = "expected table";
+		static constexpr int LuaTypes = TypeBit(LUA_TTABLE);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_istable(state, index);
+		}
+
+		static void Validate(lua_State *state, int index)
+		{
+			index = lua_absindex(state, index);
+			lua_Integer length = static_cast<lua_Integer>(lua_rawlen(state, index));
+			for (lua_Integer i = 1; i <= length; ++i)
+			{
+				lua_rawgeti(state, index, i);
+				CheckElement<T>(state, i);
+				lua_pop(state, 1);
+			}
+		}
+
+		static inline std::vector<T, A> Get(lua_State *state, int index)
+		{
+			Validate(state, index);
+			return Build(state, index);
+		}
+
+		static std::vector<T, A> Build(lua_State *state, int index)
+		{
+			index = lua_absindex(state, index);
+			lua_Integer length = static_cast<lua_Integer>(lua_rawlen(state, index));
+			std::vector<T, A> value;
+			value.reserve(static_cast<std::size_t>(length));
+			for (lua_Integer i = 1; i <= length; ++i)
+			{
+				lua_rawgeti(state, index, i);
+				value.push_back(BuildValue<T>(state, -1));
+				lua_pop(state, 1);
+			}
+			return value;
+		}
+
+		static int Push(lua_State *state, std::vector<T, A> const &value)
+		{
+			lua_createtable(state, static_cast<int>(value.size()), 0);
+			for (std::size_t i = 0; i < value.size(); ++i)
+			{
+				Converter<T>::Push(state, value[i]);
+				lua_rawseti(state, -2, static_cast<lua_Integer>(i + 1));
+			}
+			return 1;
+		}
+	};
+
+	// a sequence of exactly N values, e.g. std::array<float, 3> for a vector
+	template<typename T, std::size_t N>
+	struct Converter<std::array<T, N>>
+	{
+		static constexpr const char *Expected = "expected table";
+		static constexpr int LuaTypes = TypeBit(LUA_TTABLE);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_istable(state, index);
+		}
+
+		static void Validate(lua_State *state, int index)
+		{
+			index = lua_absindex(state, index);
+			for (std::size_t i = 0; i < N; ++i)
+			{
+				lua_Integer element = static_cast<lua_Integer>(i + 1);
+				lua_rawgeti(state, index, element);
+				CheckElement<T>(state, element);
+				lua_pop(state, 1);
+			}
+		}
+
+		static inline std::array<T, N> Get(lua_State *state, int index)
+		{
+			Validate(state, index);
+			return Build(state, index);
+		}
+
+		static std::array<T, N> Build(lua_State *state, int index)
+		{
+			index = lua_absindex(state, index);
+			std::array<T, N> value{};
+			for (std::size_t i = 0; i < N; ++i)
+			{
+				lua_rawgeti(state, index, static_cast<lua_Integer>(i + 1));
+				value[i] = BuildValue<T>(state, -1);
+				lua_pop(state, 1);
+			}
+			return value;
+		}
+
+		static int Push(lua_State *state, std::array<T, N> const &value)
+		{
+			lua_createtable(state, static_cast<int>(N), 0);
+			for (std::size_t i = 0; i < N; ++i)
+			{
+				Converter<T>::Push(state, value[i]);
+				lua_rawseti(state, -2, static_cast<lua_Integer>(i + 1));
+			}
+			return 1;
+		}
+	};
+
+	// a sequence {v1, v2, ...} of mixed types. Returned from a bound function a tuple becomes
+	// multiple values instead, see ReturnResult.
+	template<typename... T>
+	struct Converter<std::tuple<T...>>
+	{
+		static constexpr const char *Expected = "expected table";
+		static constexpr int LuaTypes = TypeBit(LUA_TTABLE);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_istable(state, index);
+		}
+
+		static inline void Validate(lua_State *state, int index)
+		{
+			Validate(state, lua_absindex(state, index), std::index_sequence_for<T...>());
+		}
+
+		static inline std::tuple<T...> Get(lua_State *state, int index)
+		{
+			Validate(state, index);
+			return Build(state, index);
+		}
+
+		static inline std::tuple<T...> Build(lua_State *state, int index)
+		{
+			return Build(state, lua_absindex(state, index), std::index_sequence_for<T...>());
+		}
+
+		static int Push(lua_State *state, std::tuple<T...> const &value)
+		{
+			lua_createtable(state, static_cast<int>(sizeof...(T)), 0);
+			Push(state, value, std::index_sequence_for<T...>());
+			return 1;
+		}
+
+	private:
+		template<std::size_t... I>
+		static void Validate(lua_State *state, int index, std::index_sequence<I...>)
+		{
+			(void)state; // unused for an empty tuple
+			(void)index;
+			((lua_rawgeti(state, index, static_cast<lua_Integer>(I + 1)),
+				CheckElement<T>(state, static_cast<lua_Integer>(I + 1)),
+				lua_pop(state, 1)), ...);
+		}
+
+		template<std::size_t... I>
+		static std::tuple<T...> Build(lua_State *state, int index, std::index_sequence<I...>)
+		{
+			std::tuple<T...> value;
+			auto build = [state, index](auto &dest, lua_Integer element)
+			{
+				lua_rawgeti(state, index, element);
+				dest = BuildValue<typename std::decay<decltype(dest)>::type>(state, -1);
+				lua_pop(state, 1);
+			};
+			(void)build; // unused for an empty tuple
+			(build(std::get<I>(value), static_cast<lua_Integer>(I + 1)), ...);
+			return value;
+		}
+
+		template<std::size_t... I>
+		static void Push(lua_State *state, std::tuple<T...> const &value, std::index_sequence<I...>)
+		{
+			((Converter<T>::Push(state, std::get<I>(value)),
+				lua_rawseti(state, -2, static_cast<lua_Integer>(I + 1))), ...);
+		}
+	};
+
+	// a table {[k1] = v1, ...}, integer keys go to the array part when pushed
+	template<typename K, typename V, typename C, typename A>
+	struct Converter<std::map<K, V, C, A>>
+	{
+		static constexpr const char *Expected = "expected table";
+		static constexpr int LuaTypes = TypeBit(LUA_TTABLE);
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return lua_istable(state, index);
+		}
+
+		static void Validate(lua_State *state, int index)
+		{
+			index = lua_absindex(state, index);
+			lua_pushnil(state);
+			while (lua_next(state, index) != 0)
+			{
+				// checked on a copy, lua_tolstring would change a number key in place
+				lua_pushvalue(state, -2);
+				if (!Converter<K>::Check(state, -1))
+				{
+					luaL_error(state, "bad key (%s, got %s)", ExpectedOf<K>(state),
+						luaL_typename(state, -1));
+				}
+				ValidateValue<K>(state, -1);
+				lua_pop(state, 1);
+				if (!Converter<V>::Check(state, -1))
+				{
+					luaL_error(state, "bad value (%s, got %s)", ExpectedOf<V>(state),
+						luaL_typename(state, -1));
+				}
+				ValidateValue<V>(state, -1);
+				lua_pop(state, 1);
+			}
+		}
+
+		static inline std::map<K, V, C, A> Get(lua_State *state, int index)
+		{
+			Validate(state, index);
+			return Build(state, index);
+		}
+
+		static std::map<K, V, C, A> Build(lua_State *state, int index)
+		{
+			index = lua_absindex(state, index);
+			std::map<K, V, C, A> value;
+			lua_pushnil(state);
+			while (lua_next(state, index) != 0)
+			{
+				// converted from a copy, lua_tolstring would change a number key in place
+				lua_pushvalue(state, -2);
+				K key = BuildValue<K>(state, -1);
+				lua_pop(state, 1);
+				value.emplace(std::move(key), BuildValue<V>(state, -1));
+				lua_pop(state, 1);
+			}
+			return value;
+		}
+
+		static int Push(lua_State *state, std::map<K, V, C, A> const &value)
+		{
+			lua_createtable(state, 0, static_cast<int>(value.size()));
+			for (auto const &e : value)
+			{
+				if constexpr (std::is_integral<K>::value && !std::is_same<K, bool>::value)
+				{
+					Converter<V>::Push(state, e.second);
+					lua_rawseti(state, -2, static_cast<lua_Integer>(e.first));
+				}
+				else
+				{
+					Converter<K>::Push(state, e.first);
+					Converter<V>::Push(state, e.second);
+					lua_rawset(state, -3);
+				}
+			}
+			return 1;
+		}
+	};
+}
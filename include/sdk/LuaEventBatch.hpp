@@ -0,0 +1,137 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include "LuaFunctionUtils.hpp"
+
+
+namespace Lua
+{
+	// Pushes all entries of a batch as one table with a column per argument: batch[j][i] is
+	// argument j of entry i, batch.n the number of entries. Conversions may raise Lua errors.
+	static void PushBatchTable(lua_State *state, std::size_t count, PushBatchArgumentsFn push, void *context)
+	{
+		lua_createtable(state, 4, 1);
+		int batch = lua_gettop(state);
+		lua_pushinteger(state, static_cast<lua_Integer>(count));
+		lua_setfield(state, batch, "n");
+
+		// the columns are kept on the stack below the arguments of the current entry
+		int columns = 0;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			int arg_count = push(state, context, i);
+			while (columns < arg_count)
+			{
+				luaL_checkstack(state, 2, nullptr);
+				lua_createtable(state, static_cast<int>(count), 0);
+				lua_pushvalue(state, -1);
+				lua_rawseti(state, batch, ++columns);
+				lua_insert(state, batch + columns);
+			}
+			for (int j = arg_count; j >= 1; --j)
+				lua_rawseti(state, batch + j, static_cast<lua_Integer>(i) + 1);
+		}
+		lua_settop(state, batch);
+	}
+
+	// Dispatch of a batch to one Lua function, used by the server for IServerPlugin::CallEventBatch
+	struct BatchCall
+	{
+		std::size_t next;
+		std::size_t count;
+		PushBatchArgumentsFn push;
+		void *context;
+	};
+
+	// protected part of CallBatch, the BatchCall is at 1 and the function at 2
+	static int CallBatchEntries(lua_State *state)
+	{
+		auto batch = static_cast<BatchCall *>(lua_touserdata(state, 1));
+		while (batch->next < batch->count)
+		{
+			std::size_t index = batch->next++; // an error skips this entry
+			lua_pushvalue(state, 2);
+			int arg_count = batch->push(state, batch->context, index);
+			lua_call(state, arg_count, 0);
+		}
+		return 0;
+	}
+
+	// protected part of CallBatchTable, the BatchCall is at 1 and the function at 2
+	static int CallBatchTableEntries(lua_State *state)
+	{
+		auto batch = static_cast<BatchCall *>(lua_touserdata(state, 1));
+		PushBatchTable(state, batch->count, batch->push, batch->context);
+		lua_call(state, 1, 0);
+		return 0;
+	}
+
+	// Calls the function at index once per entry of a batch with its arguments. All calls share
+	// one protected call; after an error, on_error(message) is called and the batch continues with
+	// the next entry in a new one. Returns the number of failed calls.
+	template<typename OnError>
+	std::size_t CallBatch(lua_State *state, int index, std::size_t count, PushBatchArgumentsFn push,
+		void *context, OnError &&on_error)
+	{
+		index = lua_absindex(state, index);
+		lua_pushcfunction(state, &CallMessageHandler);
+		int handler = lua_gettop(state);
+
+		BatchCall batch{ 0, count, push, context };
+		std::size_t failed = 0;
+		while (batch.next < count)
+		{
+			lua_pushcfunction(state, &CallBatchEntries);
+			lua_pushlightuserdata(state, &batch);
+			lua_pushvalue(state, index);
+			if (lua_pcall(state, 2, 0, handler) != LUA_OK)
+			{
+				++failed;
+				on_error(lua_tostring(state, -1));
+				lua_pop(state, 1);
+			}
+		}
+		lua_pop(state, 1);
+		return failed;
+	}
+
+	// Calls the function at index once with all entries of a batch in a table, see
+	// PushBatchTable. Returns false after passing the error message to on_error.
+	template<typename OnError>
+	bool CallBatchTable(lua_State *state, int index, std::size_t count, PushBatchArgumentsFn push,
+		void *context, OnError &&on_error)
+	{
+		index = lua_absindex(state, index);
+		lua_pushcfunction(state, &CallMessageHandler);
+		int handler = lua_gettop(state);
+
+		BatchCall batch{ 0, count, push, context };
+		lua_pushcfunction(state, &CallBatchTableEntries);
+		lua_pushlightuserdata(state, &batch);
+		lua_pushvalue(state, index);
+		bool success = lua_pcall(state, 2, 0, handler) == LUA_OK;
+		if (!success)
+		{
+			on_error(lua_tostring(state, -1));
+			lua_pop(state, 1);
+		}
+		lua_pop(state, 1);
+		return success;
+	}
+}
@@ -15,74 +15,208 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 #pragma once
 
 #include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "LuaPool.hpp"
+#include "LuaRefPool.hpp"
 
 
 namespace Lua
 {
-	class LuaFunction
+	// Outcome of LuaFunction::Call, converts to true on success. Results which are missing or
+	// nil keep their default value.
+	template<typename... R>
+	class LuaCallResult
 	{
 	private:
-		lua_State *_state;
-		int _key;
-		bool _valid = false;
+		std::tuple<R...> _values;
+		std::string _error; // error message with traceback, empty on success
+		bool _success = false;
 
 	public:
-		LuaFunction(lua_State *state) : _state(state) { }
+		inline explicit operator bool() const
+		{
+			return _success;
+		}
+
+		inline std::string const &GetError() const
+		{
+			return _error;
+		}
+
+		inline std::tuple<R...> &GetValues()
+		{
+			return _values;
+		}
+
+		template<std::size_t I>
+		inline typename std::tuple_element<I, std::tuple<R...>>::type &Get()
+		{
+			return std::get<I>(_values);
+		}
+
+		// the only result of a Call<R>
+		template<std::size_t N = sizeof...(R), typename std::enable_if<N == 1, int>::type = 0>
+		inline typename std::tuple_element<N - 1, std::tuple<R...>>::type &Value()
+		{
+			return std::get<0>(_values);
+		}
+
+		inline void SetError(std::string error)
+		{
+			_success = false;
+			_error = std::move(error);
+		}
+
+		inline void SetSuccess()
+		{
+			_success = true;
+		}
+	};
+
+	// Move-only handle to a Lua function: the RefPoolLink of its state and a registry slot from
+	// RefPool, 16 bytes including the reference count used by LuaFunction_t. It can be held by
+	// value, LuaFunction_t is only needed to share it, e.g. inside a LuaValue. A handle may
+	// outlive its state, it becomes invalid when the state is closed.
+	class LuaFunction : public RefCounted
+	{
+	private:
+		int _ref = LUA_NOREF;
+		RefPoolLink *_link = nullptr; // also the state to parse from until a function is referenced
+
+	public:
+		// functions come from a thread-local pool, see ObjectPool
+		static void *operator new(std::size_t size)
+		{
+			return ObjectPool<sizeof(LuaFunction)>::Allocate(size);
+		}
+		static void operator delete(void *ptr, std::size_t size)
+		{
+			ObjectPool<sizeof(LuaFunction)>::Free(ptr, size);
+		}
+
+		LuaFunction() = default;
+		LuaFunction(lua_State *state)
+		{
+			Link(RefPool::GetLink(state));
+		}
 		LuaFunction(lua_State *state, const char *name) : LuaFunction(state)
 		{
 			lua_getglobal(state, name);
-			if (!lua_isfunction(state, 0))
+			if (!lua_isfunction(state, -1))
 			{
-				lua_pop(state, 0);
+				lua_pop(state, 1);
 				return;
 			}
-			_key = luaL_ref(state, LUA_REGISTRYINDEX);
-			_valid = true;
+			Reference(state);
 		}
 		~LuaFunction()
 		{
-			if (_valid)
-				luaL_unref(_state, LUA_REGISTRYINDEX, _key);
+			Unreference();
+			Unlink();
 		}
 
 		LuaFunction(LuaFunction const &) = delete;
 		LuaFunction &operator=(LuaFunction const &) = delete;
 
-		LuaFunction(LuaFunction &&rhs) : 
-			_state(rhs._state),
-			_key(rhs._key),
-			_valid(rhs._valid)
-		{ }
-		LuaFunction &operator=(LuaFunction &&rhs)
+		LuaFunction(LuaFunction &&rhs) noexcept :
+			_ref(rhs._ref),
+			_link(rhs._link)
+		{
+			rhs._ref = LUA_NOREF;
+			rhs._link = nullptr;
+		}
+		LuaFunction &operator=(LuaFunction &&rhs) noexcept
 		{
-			_state = rhs._state;
-			_key = rhs._key;
-			_valid = rhs._valid;
+			if (this != &rhs)
+			{
+				Unreference();
+				Unlink();
+				_ref = rhs._ref;
+				_link = rhs._link;
+				rhs._ref = LUA_NOREF;
+				rhs._link = nullptr;
+			}
 			return *this;
 		}
 
 	public:
+		// false once the state is closed
 		inline bool IsValid() const
 		{
-			return _valid;
+			return _ref > 0 && _link->IsAlive();
+		}
+
+		// the main thread of the function's state, nullptr once it is closed
+		inline lua_State *GetState() const
+		{
+			return _link != nullptr ? _link->state : nullptr;
 		}
 
+		// references the value at index of the state passed to the constructor
 		void ParseFromLua(int index)
 		{
-			lua_pushvalue(_state, index);
-			_key = luaL_ref(_state, LUA_REGISTRYINDEX);
-			_valid = true;
+			if (GetState() != nullptr)
+				ParseFromLua(GetState(), index);
 		}
 
+		void ParseFromLua(lua_State *state, int index)
+		{
+			Unreference();
+			lua_pushvalue(state, index);
+			Reference(state);
+		}
+
+		// pushes nil if the function is invalid or belongs to another Lua universe
 		void PushToLua(lua_State *state) const
 		{
-			if (state != _state)
+			if (!IsValid() || (state != _link->state && GetMainThread(state) != _link->state))
+			{
+				lua_pushnil(state);
 				return;
+			}
+
+			RefPool::PushValue(state, _ref);
+		}
+
+		// Calls the function in protected mode, arguments are pushed directly like ReturnValues
+		// does and the results are converted to R... (defined in LuaFunctionUtils.hpp)
+		template<typename... R, typename... Args>
+		LuaCallResult<R...> Call(Args&&... args) const;
 
-			if (!_valid)
+	private:
+		// pops the function into a registry slot, the coroutine it came from may die before us
+		inline void Reference(lua_State *state)
+		{
+			RefPoolLink *link = _link != nullptr && _link->state == state ? _link : RefPool::GetLink(state);
+			_ref = RefPool::Ref(state, link);
+			Link(link);
+		}
+
+		inline void Unreference()
+		{
+			if (_ref > 0)
+				RefPool::Unref(_link, _ref);
+			_ref = LUA_NOREF;
+		}
+
+		inline void Link(RefPoolLink *link)
+		{
+			if (link == _link)
 				return;
 
-			lua_rawgeti(_state, LUA_REGISTRYINDEX, _key);
+			link->AddRef();
+			Unlink();
+			_link = link;
+		}
+
+		inline void Unlink()
+		{
+			if (_link != nullptr && _link->Release())
+				delete _link;
+			_link = nullptr;
 		}
 
 	public: // static helper func
@@ -92,4 +226,17 @@ namespace Lua
 			return LuaFunction_t(new LuaFunction(std::forward<Args>(args)...));
 		}
 	};
+
+	static_assert(sizeof(LuaFunction) == 16, "LuaFunction is expected to be 16 bytes");
+
+	inline void IntrusiveAddRef(LuaFunction *ptr)
+	{
+		ptr->AddRef();
+	}
+
+	inline void IntrusiveRelease(LuaFunction *ptr)
+	{
+		if (ptr->Release())
+			delete ptr;
+	}
 }
@@ -14,10 +14,18 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 
 #pragma once
 
+#include <cstddef>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include "LuaValue.hpp"
 #include "LuaTable.hpp"
+#include "LuaTableRef.hpp"
 #include "LuaFunction.hpp"
+#include "LuaConverter.hpp"
 
 namespace Lua
 {
@@ -79,181 +87,59 @@ namespace Lua
 	}
 
 
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, int &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, unsigned int &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, double &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, float &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, bool &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, std::string &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, LuaTable_t &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	void ParseArguments(lua_State *state, LuaFunction_t &arg, Args&... args);
+	// The remaining arguments as values, see ParseValueFromLua. Only valid as last argument.
 	template<int Idx = 1>
-	void ParseArguments(lua_State *state, LuaArgs_t &arg);
-
-	template<int Idx>
-	void ParseArguments(lua_State *state)
+	void ParseArguments(lua_State *state, LuaArgs_t &arg)
 	{
-		(void)state; // unused
+		int idx = Idx;
+		while (lua_type(state, idx) != LUA_TNONE)
+			arg.push_back(ParseValueFromLua(state, idx++));
 	}
 
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, int &arg, Args&... args)
+	// strings and tables are allocated from the vector's memory resource as well
+	template<int Idx = 1>
+	void ParseArguments(lua_State *state, pmr::LuaArgs_t &arg)
 	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)
-		{
-			arg = static_cast<int>(lua_tointeger(state, Idx));
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected integer-like argument");
-		}
+		std::pmr::memory_resource *resource = arg.get_allocator().resource();
+		int top = lua_gettop(state);
+		if (top >= Idx)
+			arg.reserve(arg.size() + static_cast<std::size_t>(top - Idx + 1));
+		for (int idx = Idx; idx <= top; ++idx)
+			arg.push_back(ParseValueFromLua(state, idx, resource));
 	}
 
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, unsigned int &arg, Args&... args)
+	template<int Idx>
+	void ParseArguments(lua_State *state)
 	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)
-		{
-			arg = static_cast<unsigned int>(lua_tointeger(state, Idx));
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected integer-like argument");
-		}
+		(void)state; // unused
 	}
 
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, double &arg, Args&... args)
+	// converts every argument with its Converter, raises an argument error on a mismatch
+	template<int Idx = 1, typename T, typename... Args>
+	void ParseArguments(lua_State *state, T &arg, Args&... args)
 	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TSTRING)
-		{
-			arg = static_cast<double>(lua_tonumber(state, Idx));
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected number argument");
-		}
-	}
+		if (!Converter<T>::Check(state, Idx))
+			luaL_argerror(state, Idx, ExpectedOf<T>(state));
 
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, float &arg, Args&... args)
-	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TSTRING)
-		{
-			arg = static_cast<float>(lua_tonumber(state, Idx));
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected number argument");
-		}
+		arg = Converter<T>::Get(state, Idx);
+		ParseArguments<Idx + 1>(state, args...);
 	}
 
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, bool &arg, Args&... args)
-	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)
-		{
-			arg = lua_toboolean(state, Idx) != 0;
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected boolean-like argument");
-		}
-	}
 
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, std::string &arg, Args&... args)
-	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TSTRING || type == LUA_TNUMBER)
-		{
-			arg.assign(lua_tostring(state, Idx));
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected string-like argument");
-		}
-	}
-
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, LuaTable_t &arg, Args&... args)
-	{
-		if (lua_istable(state, Idx))
-		{
-			if (!arg)
-				arg.reset(new LuaTable);
-			arg->ParseFromLua(state, Idx);
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected table");
-		}
-	}
-
-	template<int Idx, typename... Args>
-	void ParseArguments(lua_State *state, LuaFunction_t &arg, Args&... args)
+	template<int Idx = 1>
+	bool ParseOptionalArguments(lua_State *state, LuaArgs_t &arg)
 	{
-		if (lua_isfunction(state, Idx))
-		{
-			if (!arg)
-				arg.reset(new LuaFunction(state));
-			arg->ParseFromLua(Idx);
-			ParseArguments<Idx + 1>(state, args...);
-		}
-		else
-		{
-			luaL_argerror(state, Idx, "expected function");
-		}
+		ParseArguments<Idx>(state, arg);
+		return true;
 	}
 
-	template<int Idx>
-	void ParseArguments(lua_State *state, LuaArgs_t &arg)
+	template<int Idx = 1>
+	bool ParseOptionalArguments(lua_State *state, pmr::LuaArgs_t &arg)
 	{
-		int idx = Idx;
-		while (lua_type(state, idx) != LUA_TNONE)
-			arg.push_back(ParseValueFromLua(state, idx++));
+		ParseArguments<Idx>(state, arg);
+		return true;
 	}
 
-
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, int &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, unsigned int &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, double &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, float &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, bool &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, std::string &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, LuaTable_t &arg, Args&... args);
-	template<int Idx = 1, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, LuaFunction_t &arg, Args&... args);
-	template<int Idx = 1>
-	bool ParseOptionalArguments(lua_State *state, LuaArgs_t &arg);
-
 	template<int Idx>
 	bool ParseOptionalArguments(lua_State *state)
 	{
@@ -261,225 +147,209 @@ namespace Lua
 		return true;
 	}
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, int &arg, Args&... args)
+	// like ParseArguments, but stops and returns false at the first missing argument
+	template<int Idx = 1, typename T, typename... Args>
+	bool ParseOptionalArguments(lua_State *state, T &arg, Args&... args)
 	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)
-		{
-			arg = static_cast<int>(lua_tointeger(state, Idx));
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (type != LUA_TNONE)
-		{
-			luaL_argerror(state, Idx, "expected integer-like argument");
-		}
-		return false;
-	}
+		if (lua_isnone(state, Idx))
+			return false;
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, unsigned int &arg, Args&... args)
-	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)
-		{
-			arg = static_cast<unsigned int>(lua_tointeger(state, Idx));
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (type != LUA_TNONE)
-		{
-			luaL_argerror(state, Idx, "expected integer-like argument");
-		}
-		return false;
-	}
+		if (!Converter<T>::Check(state, Idx))
+			luaL_argerror(state, Idx, ExpectedOf<T>(state));
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, double &arg, Args&... args)
-	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TSTRING)
-		{
-			arg = static_cast<double>(lua_tonumber(state, Idx));
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (type != LUA_TNONE)
-		{
-			luaL_argerror(state, Idx, "expected number argument");
-		}
-		return false;
+		arg = Converter<T>::Get(state, Idx);
+		return ParseOptionalArguments<Idx + 1>(state, args...);
 	}
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, float &arg, Args&... args)
-	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TSTRING)
-		{
-			arg = static_cast<float>(lua_tonumber(state, Idx));
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (type != LUA_TNONE)
-		{
-			luaL_argerror(state, Idx, "expected number argument");
-		}
-		return false;
-	}
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, bool &arg, Args&... args)
+	static int ReturnValues(lua_State *state)
 	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)
-		{
-			arg = static_cast<bool>(lua_toboolean(state, Idx));
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (type != LUA_TNONE)
-		{
-			luaL_argerror(state, Idx, "expected boolean-like argument");
-		}
-		return false;
+		(void)state; // unused
+		return 0;
 	}
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, std::string &arg, Args&... args)
+	// pushes every value with its Converter, returns the number of values pushed
+	template<typename T, typename... Args>
+	int ReturnValues(lua_State *state, T &&arg, Args&&... args)
 	{
-		int type = lua_type(state, Idx);
-		if (type == LUA_TSTRING || type == LUA_TNUMBER)
-		{
-			arg.assign(lua_tostring(state, Idx));
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (type != LUA_TNONE)
-		{
-			luaL_argerror(state, Idx, "expected string-like argument");
-		}
-		return false;
+		int count = Converter<typename std::decay<T>::type>::Push(state, arg);
+		return ReturnValues(state, std::forward<Args>(args)...) + count;
 	}
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, LuaTable_t &arg, Args&... args)
+	// Pushes arguments onto state for a callee that doesn't know their types, returns the number
+	// of values pushed
+	using PushArgumentsFn = int (*)(lua_State *state, void *context);
+
+	// PushArgumentsFn for a std::tuple of references as made by std::forward_as_tuple, the values
+	// are pushed as by ReturnValues. They are not moved from, it may be called more than once.
+	template<typename Tuple>
+	int PushArgumentTuple(lua_State *state, void *context)
 	{
-		if (lua_istable(state, Idx))
-		{
-			if (!arg)
-				arg.reset(new LuaTable);
-			arg->ParseFromLua(state, Idx);
-			return ParseOptionalArguments<Idx + 1>(state, args...);
-		}
-		else if (lua_isnone(state, Idx) == 0)
+		luaL_checkstack(state, static_cast<int>(std::tuple_size<Tuple>::value), "too many arguments");
+		return std::apply([state](auto&... values)
 		{
-			luaL_argerror(state, Idx, "expected table");
-		}
-		return false;
+			return ReturnValues(state, values...);
+		}, *static_cast<Tuple *>(context));
 	}
 
-	template<int Idx, typename... Args>
-	bool ParseOptionalArguments(lua_State *state, LuaFunction_t &arg, Args&... args)
+	// Pushes the arguments of entry index of a batch, see IServerPlugin::CallEventBatch
+	using PushBatchArgumentsFn = int (*)(lua_State *state, void *context, std::size_t index);
+
+	// message handler for LuaFunction::Call, appends a traceback like the standalone interpreter
+	static int CallMessageHandler(lua_State *state)
 	{
-		if (lua_isfunction(state, Idx))
+		const char *message = lua_tostring(state, 1);
+		if (message == nullptr)
 		{
-			if (!arg)
-				arg.reset(new LuaFunction(state));
-			arg->ParseFromLua(Idx);
-			return ParseOptionalArguments<Idx + 1>(state, args...);
+			if (luaL_callmeta(state, 1, "__tostring") && lua_type(state, -1) == LUA_TSTRING)
+				return 1;
+			message = lua_pushfstring(state, "(error object is a %s value)", luaL_typename(state, 1));
 		}
-		else if (lua_isnone(state, Idx) == 0)
-		{
-			luaL_argerror(state, Idx, "expected function");
-		}
-		return false;
+		luaL_traceback(state, state, message, 1);
+		return 1;
 	}
 
-	template<int Idx>
-	bool ParseOptionalArguments(lua_State *state, LuaArgs_t &arg)
+	// Converts one result of a call with its Converter, returns false on a type mismatch.
+	// nil leaves dest untouched.
+	template<typename T>
+	bool ParseCallResult(lua_State *state, int index, T &dest)
 	{
-		ParseArguments<Idx>(state, arg);
+		static_assert(!std::is_same<T, std::string_view>::value && !std::is_same<T, LuaTableRef>::value,
+			"results are popped once the call returns, use std::string or LuaTable_t");
+
+		if (lua_isnoneornil(state, index))
+			return true;
+
+		if (!Converter<T>::Check(state, index))
+			return false;
+
+		dest = Converter<T>::Get(state, index);
 		return true;
 	}
 
-	static int ReturnValues(lua_State *state)
+	// returns 0 or the 1-based position of the first result which couldn't be converted
+	template<typename Tuple, std::size_t... I>
+	int ParseCallResults(lua_State *state, int first, Tuple &values, std::index_sequence<I...>)
 	{
-		(void)state; // unused
-		return 0;
+		int failed = 0;
+		auto parse = [&](auto &dest, int position)
+		{
+			if (failed == 0 && !ParseCallResult(state, first + position - 1, dest))
+				failed = position;
+		};
+		(void)parse; // unused without results
+		(parse(std::get<I>(values), static_cast<int>(I) + 1), ...);
+		return failed;
 	}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, int arg, Args&&... args)
-	{
-		lua_pushinteger(state, arg);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
-	}
+	// Receives the results of one callee, e.g. an event handler, on top of the stack from index
+	// first on. Returns false to stop calling further ones.
+	using CollectResultsFn = bool (*)(lua_State *state, int first, int count, void *context);
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, unsigned int arg, Args&&... args)
+	// CollectResultsFn forwarding to a Collector passed as context
+	template<typename Collector>
+	bool CollectResultsWith(lua_State *state, int first, int count, void *context)
 	{
-		lua_pushinteger(state, static_cast<lua_Integer>(arg));
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
+		return (*static_cast<Collector *>(context))(state, first, count);
 	}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, long long arg, Args&&... args)
-	{
-		lua_pushinteger(state, arg);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
-	}
+	// Results whose Converter can't raise an error, they are converted after the call returned.
+	// Anything else is converted inside the protected call, see CallAndParseResults.
+	template<typename T>
+	struct IsPlainResult : std::integral_constant<bool, std::is_arithmetic<T>::value
+		|| std::is_enum<T>::value || std::is_same<T, std::string>::value
+		|| std::is_same<T, LuaFunction_t>::value> { };
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, unsigned long long arg, Args&&... args)
-	{
-		lua_pushinteger(state, arg);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
-	}
+	template<typename T>
+	struct IsPlainResult<std::optional<T>> : IsPlainResult<T> { };
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, double arg, Args&&... args)
+	template<typename... R>
+	void SetCallResult(LuaCallResult<R...> &result, int failed)
 	{
-		lua_pushnumber(state, arg);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
+		if (failed != 0)
+			result.SetError("bad result #" + std::to_string(failed));
+		else
+			result.SetSuccess();
 	}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, bool arg, Args&&... args)
+	// Converts count results starting at first like LuaFunction::Call does, a single LuaArgs_t
+	// receives all of them as values
+	template<typename... R>
+	void ParseResults(lua_State *state, int first, int count, LuaCallResult<R...> &result)
 	{
-		lua_pushboolean(state, arg);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
+		if constexpr (std::is_same<std::tuple<R...>, std::tuple<LuaArgs_t>>::value)
+		{
+			LuaArgs_t &values = result.Value();
+			values.reserve(values.size() + count);
+			for (int i = 0; i < count; ++i)
+				values.push_back(ParseValueFromLua(state, first + i));
+			result.SetSuccess();
+		}
+		else
+		{
+			(void)count; // missing results are nil
+			SetCallResult(result, ParseCallResults(state, first, result.GetValues(), std::index_sequence_for<R...>()));
+		}
 	}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, std::string const &arg, Args&&... args)
+	// Runs protected below LuaFunction::Call with the result object, the function and its
+	// arguments on the stack, so a Converter raising an error can't escape the call
+	template<typename... R>
+	int CallAndParseResults(lua_State *state)
 	{
-		lua_pushlstring(state, arg.c_str(), arg.length());
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
+		LuaCallResult<R...> &result = *static_cast<LuaCallResult<R...> *>(lua_touserdata(state, 1));
+		lua_call(state, lua_gettop(state) - 2, static_cast<int>(sizeof...(R)));
+		SetCallResult(result, ParseCallResults(state, 2, result.GetValues(), std::index_sequence_for<R...>()));
+		return 0;
 	}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, const char *arg, Args&&... args)
+	template<typename... R, typename... Args>
+	LuaCallResult<R...> LuaFunction::Call(Args&&... args) const
 	{
-		lua_pushstring(state, arg); // pushes nil if arg is nullptr
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
-	}
+		constexpr bool plain_results = (IsPlainResult<R>::value && ...);
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, LuaTable_t const arg, Args&&... args)
-	{
-		arg->PushToLua(state);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
-	}
+		LuaCallResult<R...> result;
+		if (!IsValid())
+		{
+			result.SetError("attempt to call an invalid function");
+			return result;
+		}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, LuaFunction_t const arg, Args&&... args)
-	{
-		arg->PushToLua(state);
-		return ReturnValues(state, std::forward<Args>(args)...) + 1;
-	}
+		lua_State *state = _link->state;
+		int top = lua_gettop(state);
+		if (!lua_checkstack(state, static_cast<int>(sizeof...(Args)) + 4))
+		{
+			result.SetError("stack overflow");
+			return result;
+		}
 
-	template<typename... Args>
-	int ReturnValues(lua_State *state, LuaArgs_t const &arg, Args&&... args)
-	{
-		for (auto const &e : arg)
-			PushValueToLua(e, state);
-		return ReturnValues(state, std::forward<Args>(args)...) 
-			+ static_cast<int>(arg.size());
+		// light C functions and a light userdata, pushing them doesn't allocate
+		lua_pushcfunction(state, &CallMessageHandler);
+		if constexpr (!plain_results)
+		{
+			lua_pushcfunction(state, &CallAndParseResults<R...>);
+			lua_pushlightuserdata(state, &result);
+		}
+		RefPool::PushValue(state, _ref);
+		int arg_count = ReturnValues(state, std::forward<Args>(args)...);
+
+		int status;
+		if constexpr (plain_results)
+			status = lua_pcall(state, arg_count, static_cast<int>(sizeof...(R)), top + 1);
+		else
+			status = lua_pcall(state, arg_count + 2, 0, top + 1);
+
+		if (status != LUA_OK)
+		{
+			size_t length = 0;
+			const char *message = lua_tolstring(state, -1, &length);
+			result.SetError(message != nullptr ? std::string(message, length) : std::string("unknown error"));
+		}
+		else if constexpr (plain_results)
+		{
+			SetCallResult(result, ParseCallResults(state, top + 2, result.GetValues(), std::index_sequence_for<R...>()));
+		}
+		lua_settop(state, top);
+		return result;
 	}
 }
@@ -0,0 +1,91 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+
+namespace Lua
+{
+	// Thread-local free list of blocks of one size, used as class allocator for LuaTable and
+	// LuaFunction. A block freed on another thread simply joins that thread's list.
+	template<std::size_t Size>
+	class ObjectPool
+	{
+	private:
+		static constexpr std::size_t MaxFree = 1024; // per thread, the rest goes back to the heap
+
+		struct Node
+		{
+			Node *next;
+		};
+
+		struct FreeList
+		{
+			Node *head = nullptr;
+			std::size_t count = 0;
+			bool destroyed = false;
+
+			~FreeList()
+			{
+				while (head != nullptr)
+				{
+					Node *next = head->next;
+					::operator delete(head);
+					head = next;
+				}
+				destroyed = true; // objects released by later thread-local destructors bypass us
+			}
+		};
+
+		static FreeList &Local()
+		{
+			thread_local FreeList list;
+			return list;
+		}
+
+	public:
+		static void *Allocate(std::size_t size)
+		{
+			FreeList &list = Local();
+			if (size != Size || list.head == nullptr)
+				return ::operator new(size < sizeof(Node) ? sizeof(Node) : size);
+
+			Node *node = list.head;
+			list.head = node->next;
+			--list.count;
+			return node;
+		}
+
+		static void Free(void *ptr, std::size_t size)
+		{
+			if (ptr == nullptr)
+				return;
+
+			FreeList &list = Local();
+			if (size != Size || list.destroyed || list.count >= MaxFree)
+			{
+				::operator delete(ptr);
+				return;
+			}
+
+			Node *node = static_cast<Node *>(ptr);
+			node->next = list.head;
+			list.head = node;
+			++list.count;
+		}
+	};
+}
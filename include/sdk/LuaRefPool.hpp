@@ -0,0 +1,169 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <new>
+#include <vector>
+
+#include "LuaTypes.hpp"
+
+
+namespace Lua
+{
+	// all coroutines of a Lua universe share the registry
+	inline lua_State *GetMainThread(lua_State *state)
+	{
+		lua_rawgeti(state, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+		lua_State *main = lua_tothread(state, -1);
+		lua_pop(state, 1);
+		return main;
+	}
+
+	class RefPool;
+
+	// Lets handles outlive their state: the pool clears it when the state is closed, the link
+	// itself stays until the last handle is gone. Not thread-safe beyond its reference count,
+	// like the state it refers to.
+	struct RefPoolLink : RefCounted
+	{
+		lua_State *state = nullptr; // the main thread, nullptr once closed
+		RefPool *pool = nullptr;
+
+		inline bool IsAlive() const
+		{
+			return state != nullptr;
+		}
+	};
+
+	// Per-state pool of registry slots for values referenced from native code. Slots are
+	// reserved with luaL_ref in batches and never handed back, a released slot is overwritten
+	// with false and reused from a native free list. Callback churn doesn't touch the free list
+	// of LUA_REGISTRYINDEX and pushing a value stays a single lua_rawgeti.
+	class RefPool
+	{
+	private:
+		static constexpr int BatchSize = 32;
+
+		std::vector<int> _free; // reserved slots not in use, reused last in first out
+		RefPoolLink *_link = nullptr;
+
+	public:
+		// the link of the pool of state, creating the pool on first use. The caller adds a
+		// reference for as long as it keeps it.
+		static RefPoolLink *GetLink(lua_State *state)
+		{
+			return Get(state)._link;
+		}
+
+		// pops the value on top of the stack into a slot and returns it
+		static inline int Ref(lua_State *state)
+		{
+			return Ref(state, GetLink(state));
+		}
+
+		// link is that of state, to save looking it up
+		static int Ref(lua_State *state, RefPoolLink const *link)
+		{
+			RefPool &pool = *link->pool;
+			if (pool._free.empty())
+				pool.Reserve(state);
+
+			int ref = pool._free.back();
+			pool._free.pop_back();
+			lua_rawseti(state, LUA_REGISTRYINDEX, ref);
+			return ref;
+		}
+
+		// does nothing once the state of link is closed
+		static void Unref(RefPoolLink const *link, int ref)
+		{
+			if (ref <= 0 || !link->IsAlive())
+				return;
+
+			lua_pushboolean(link->state, 0);
+			lua_rawseti(link->state, LUA_REGISTRYINDEX, ref);
+			link->pool->_free.push_back(ref);
+		}
+
+		static inline void Unref(lua_State *state, int ref)
+		{
+			Unref(GetLink(state), ref);
+		}
+
+		static inline void PushValue(lua_State *state, int ref)
+		{
+			lua_rawgeti(state, LUA_REGISTRYINDEX, ref);
+		}
+
+	private:
+		void Reserve(lua_State *state)
+		{
+			for (int i = 0; i < BatchSize; ++i)
+			{
+				lua_pushboolean(state, 0);
+				_free.push_back(luaL_ref(state, LUA_REGISTRYINDEX));
+			}
+		}
+
+		// the pool of state, created on first use and destroyed with the state
+		static RefPool &Get(lua_State *state)
+		{
+			RefPool *pool;
+			if (lua_rawgetp(state, LUA_REGISTRYINDEX, Key()) == LUA_TUSERDATA)
+			{
+				pool = static_cast<RefPool *>(lua_touserdata(state, -1));
+				lua_pop(state, 1);
+				return *pool;
+			}
+			lua_pop(state, 1);
+
+			pool = new (lua_newuserdatauv(state, sizeof(RefPool), 0)) RefPool();
+			pool->_link = new RefPoolLink;
+			pool->_link->AddRef();
+			pool->_link->pool = pool;
+			lua_rawgeti(state, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+			pool->_link->state = lua_tothread(state, -1);
+			lua_pop(state, 1);
+			lua_createtable(state, 0, 1);
+			lua_pushcfunction(state, &Collect);
+			lua_setfield(state, -2, "__gc");
+			lua_setmetatable(state, -2);
+			lua_rawsetp(state, LUA_REGISTRYINDEX, Key());
+			return *pool;
+		}
+
+		static int Collect(lua_State *state)
+		{
+			RefPool *pool = static_cast<RefPool *>(lua_touserdata(state, 1));
+			if (pool->_link != nullptr)
+			{
+				pool->_link->state = nullptr;
+				pool->_link->pool = nullptr;
+				if (pool->_link->Release())
+					delete pool->_link;
+				pool->_link = nullptr;
+			}
+			pool->~RefPool();
+			return 0;
+		}
+
+		// the address is the registry key
+		static const void *Key()
+		{
+			static const char key = 0;
+			return &key;
+		}
+	};
+}
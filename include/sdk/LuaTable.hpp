@@ -14,94 +14,975 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 
 #pragma once
 
+#include <atomic>
+#include <limits>
+#include <memory_resource>
 #include <string>
-#include <unordered_map>
 #include <type_traits>
 #include <functional>
+#include <vector>
 
 #include "LuaValue.hpp"
+#include "FlatHashMap.hpp"
+#include "LuaPool.hpp"
 
 
 namespace Lua
 {
-	class LuaTable
+	// Bounds for converting a Lua table, applied per call
+	struct ParseLimits
+	{
+		int MaxDepth = 64; // levels of tables nested below the converted one
+		std::size_t MaxEntries = std::numeric_limits<std::size_t>::max(); // key/value pairs in total
+	};
+
+	class LuaTable : public RefCounted
 	{
 	private:
-		std::unordered_map<LuaValue, LuaValue, LuaValue::Hash> _table;
+		// Like Lua tables, integer keys 1..n live in a contiguous array part and everything else
+		// in the hash part. Keys within the array range never appear in the hash part, missing
+		// entries in the array part are stored as invalid values.
+		std::pmr::vector<LuaValue> _array = std::pmr::vector<LuaValue>(std::pmr::new_delete_resource());
+		std::size_t _array_count = 0;
+		FlatHashMap<LuaValue, LuaValue, LuaValue::Hash> _hash;
+
+		// set for tables created by Create(resource), which allocate everything from it
+		std::pmr::memory_resource *_resource = nullptr;
+
+		// Shared by a frozen table and every Lua state caching a copy of it, so its address keeps
+		// identifying the table in those caches until the last of them lets go
+		struct FrozenState : RefCounted
+		{
+			std::atomic<bool> alive{ true }; // false once the table is destroyed
+			bool read_only = false;
+		};
+		FrozenState *_frozen = nullptr;
+
+		static constexpr lua_Integer CacheCount = 1; // fields of the cache besides the anchors
+		static constexpr lua_Integer CacheSweepAt = 2;
+		static constexpr lua_Integer CacheMinSweep = 32;
+
+		explicit LuaTable(std::pmr::memory_resource *resource) :
+			_array(resource),
+			_hash(resource),
+			_resource(resource)
+		{ }
 
 	public:
+		// tables come from a thread-local pool, see ObjectPool
+		static void *operator new(std::size_t size)
+		{
+			return ObjectPool<sizeof(LuaTable)>::Allocate(size);
+		}
+		static void *operator new(std::size_t, void *where) noexcept
+		{
+			return where;
+		}
+		static void operator delete(void *ptr, std::size_t size)
+		{
+			ObjectPool<sizeof(LuaTable)>::Free(ptr, size);
+		}
+		static void operator delete(void *, void *) noexcept
+		{ }
+
+		LuaTable() = default;
+		// copies are never frozen and always allocate from the global heap
+		LuaTable(LuaTable const &rhs) :
+			RefCounted(rhs),
+			_array(rhs._array, std::pmr::new_delete_resource()),
+			_array_count(rhs._array_count),
+			_hash(rhs._hash)
+		{ }
+		LuaTable &operator=(LuaTable const &rhs)
+		{
+			if (this != &rhs && _frozen == nullptr)
+			{
+				_array = rhs._array;
+				_array_count = rhs._array_count;
+				_hash = rhs._hash;
+			}
+			return *this;
+		}
+		// Lua copies of a frozen table stay with their states, which drop them later on
+		~LuaTable()
+		{
+			if (_frozen == nullptr)
+				return;
+
+			_frozen->alive.store(false, std::memory_order_release);
+			ReleaseFrozen(_frozen);
+		}
+
+	public:
+		// does nothing if the table is frozen
 		template<typename T, typename U>
 		inline void Add(T key, U value)
 		{
-			_table[LuaValue(key)] = LuaValue(value);
+			if (_frozen == nullptr)
+				Set(LuaValue(key), LuaValue(value));
 		}
 
 		template<typename T>
 		inline bool Exists(T key)
 		{
-			return _table.find(LuaValue(key)) != _table.end();
+			return FindValue(LuaValue(key)) != nullptr;
 		}
 		
 		template<typename T>
 		inline bool Remove(T key)
 		{
-			return _table.erase(LuaValue(key)) == 1;
+			return _frozen == nullptr && RemoveValue(LuaValue(key));
 		}
 		
 		inline int Count()
 		{
-			return static_cast<int>(_table.size());
+			return static_cast<int>(_array_count + _hash.Size());
+		}
+
+		// preallocates room for count entries
+		inline void Reserve(int count)
+		{
+			_hash.Reserve(static_cast<std::size_t>(count));
+		}
+
+		// preallocates room for the sequence 1..count
+		inline void ReserveArray(int count)
+		{
+			_array.reserve(static_cast<std::size_t>(count));
 		}
 
 		template<typename T, typename U>
 		bool TryGet(T key, U &dest)
 		{
-			auto it = _table.find(LuaValue(key));
-			if (it == _table.end())
+			LuaValue *value = FindValue(LuaValue(key));
+			if (value == nullptr)
+				return false;
+
+			return value->TryGetValue(dest);
+		}
+
+		// calls func(key, value) for every entry, the array part first in order
+		template<typename F>
+		void ForEach(F &&func) const
+		{
+			for (std::size_t i = 0; i < _array.size(); ++i)
+			{
+				if (_array[i].GetType() != LuaValue::Type::INVALID)
+					func(LuaValue(static_cast<lua_Integer>(i + 1)), _array[i]);
+			}
+			_hash.ForEach(func);
+		}
+
+		// like ForEach, but stops as soon as func returns false; returns false in that case
+		template<typename F>
+		bool ForEachWhile(F &&func) const
+		{
+			for (std::size_t i = 0; i < _array.size(); ++i)
+			{
+				if (_array[i].GetType() != LuaValue::Type::INVALID
+					&& !func(LuaValue(static_cast<lua_Integer>(i + 1)), _array[i]))
+				{
+					return false;
+				}
+			}
+			return _hash.ForEachWhile(func);
+		}
+
+		// calls func(key, value) for the entries for which pred(key, value) is true
+		template<typename P, typename F>
+		void ForEachIf(P &&pred, F &&func) const
+		{
+			ForEach([&pred, &func](LuaValue const &key, LuaValue const &value)
+			{
+				if (pred(key, value))
+					func(key, value);
+			});
+		}
+
+		// calls func(key, value) for the entries whose value is of the given type
+		template<typename F>
+		void ForEachOfType(LuaValue::Type type, F &&func) const
+		{
+			ForEach([type, &func](LuaValue const &key, LuaValue const &value)
+			{
+				if (value.GetType() == type)
+					func(key, value);
+			});
+		}
+
+		// key and value of an entry, only valid until the iterator advances
+		struct Entry
+		{
+			LuaValue const &key;
+			LuaValue const &value;
+		};
+
+		// iterates in the same order as ForEach, invalidated by any modification of the table
+		class ConstIterator
+		{
+		private:
+			using HashIterator = FlatHashMap<LuaValue, LuaValue, LuaValue::Hash>::ConstIterator;
+
+			const LuaValue *_array_begin = nullptr;
+			const LuaValue *_array = nullptr;
+			const LuaValue *_array_end = nullptr;
+			HashIterator _hash;
+			LuaValue _key; // the key of array entries
+
+		public:
+			ConstIterator(LuaTable const &table, bool end) :
+				_array_begin(table._array.data()),
+				_array(end ? table._array.data() + table._array.size() : table._array.data()),
+				_array_end(table._array.data() + table._array.size()),
+				_hash(end ? table._hash.end() : table._hash.begin())
+			{
+				SkipHoles();
+			}
+
+		public:
+			inline Entry operator*() const
+			{
+				if (_array != _array_end)
+					return Entry{ _key, *_array };
+				return Entry{ _hash->first, _hash->second };
+			}
+
+			inline ConstIterator &operator++()
+			{
+				if (_array != _array_end)
+				{
+					++_array;
+					SkipHoles();
+				}
+				else
+				{
+					++_hash;
+				}
+				return *this;
+			}
+
+			inline bool operator==(ConstIterator const &rhs) const
+			{
+				return _array == rhs._array && _hash == rhs._hash;
+			}
+
+			inline bool operator!=(ConstIterator const &rhs) const
+			{
+				return !(*this == rhs);
+			}
+
+		private:
+			inline void SkipHoles()
+			{
+				while (_array != _array_end && _array->GetType() == LuaValue::Type::INVALID)
+					++_array;
+				if (_array != _array_end)
+					new(&_key) LuaValue(static_cast<lua_Integer>(_array - _array_begin) + 1); // holds no storage to release
+			}
+		};
+
+		inline ConstIterator begin() const
+		{
+			return ConstIterator(*this, false);
+		}
+
+		inline ConstIterator end() const
+		{
+			return ConstIterator(*this, true);
+		}
+
+		// Converts the Lua table at index, including nested tables. Subtables referenced more than
+		// once are converted once and shared. Returns false and leaves the table empty if the
+		// limits are exceeded, the table contains a reference cycle or a value which can't be
+		// converted; error then points to a static description.
+		bool ParseFromLua(lua_State *state, int index, ParseLimits const &limits = ParseLimits(),
+			const char **error = nullptr)
+		{
+			if (_frozen != nullptr)
+			{
+				if (error != nullptr)
+					*error = "table is frozen";
 				return false;
+			}
+
+			index = lua_absindex(state, index);
+			int top = lua_gettop(state);
 
-			return it->second.TryGetValue(dest);
+			const char *failure = ParseTree(state, index, limits);
+			if (failure != nullptr)
+			{
+				// release the storage too, the caller is likely about to raise a Lua error
+				lua_settop(state, top);
+				_array.clear();
+				_array.shrink_to_fit();
+				_array_count = 0;
+				_hash = FlatHashMap<LuaValue, LuaValue, LuaValue::Hash>(_resource);
+				if (error != nullptr)
+					*error = failure;
+				return false;
+			}
+			return true;
 		}
 
-		inline void ForEach(std::function<void(LuaValue const &, LuaValue const &)> func)
+		// Returns the error ParseFromLua would report for the Lua table at index, or nullptr,
+		// without converting anything. No C++ memory is allocated, so the caller may raise a Lua
+		// error right away; nested tables are tracked in a temporary Lua table.
+		static const char *ValidateLua(lua_State *state, int index, ParseLimits const &limits = ParseLimits())
 		{
-			for (auto const &e : _table)
-				func(e.first, e.second);
+			index = lua_absindex(state, index);
+			int top = lua_gettop(state);
+
+			lua_pushnil(state); // the visited tables, created for the first nested one
+			ValidateContext context{ top + 1, index, limits, 0 };
+			const char *failure = ValidateTree(state, index, 0, context);
+			lua_settop(state, top);
+			return failure;
 		}
 
-		void ParseFromLua(lua_State *state, int index)
+		// Makes this table and all tables nested in it immutable. A frozen table is converted to
+		// Lua once per lua_State and cached there, later pushes return that same table. The state
+		// owns the cache: it is freed with the state, and entries of destroyed tables are dropped
+		// as new ones are added.
+		// With read_only, scripts get a proxy which raises an error on assignment. Nested tables
+		// which are already frozen keep their mode. Not thread-safe, freeze before sharing.
+		void Freeze(bool read_only = false)
 		{
-			static int recurse_counter = 0;
-			if (recurse_counter > 3)
+			if (_frozen != nullptr)
 				return;
 
-			recurse_counter++;
-			_table.clear();
+			_frozen = new FrozenState;
+			_frozen->AddRef();
+			_frozen->read_only = read_only;
+			ForEach([read_only](LuaValue const &key, LuaValue const &value)
+			{
+				if (key.IsTable())
+					key.AsTable().Freeze(read_only);
+				if (value.IsTable())
+					value.AsTable().Freeze(read_only);
+			});
+		}
 
-			int counter = 0;
-			lua_pushnil(state);
-			while (lua_next(state, index) != 0)
+		inline bool IsFrozen() const
+		{
+			return _frozen != nullptr;
+		}
+
+		void PushToLua(lua_State *state) const
+		{
+			if (_frozen != nullptr)
+				PushFrozen(state);
+			else
+				PushCopy(state);
+		}
+
+	private:
+		void PushCopy(lua_State *state) const
+		{
+			lua_createtable(state, static_cast<int>(_array.size()), static_cast<int>(_hash.Size()));
+			for (std::size_t i = 0; i < _array.size(); ++i)
+			{
+				if (_array[i].GetType() == LuaValue::Type::INVALID)
+					continue;
+
+				PushValueToLua(_array[i], state);
+				lua_rawseti(state, -2, static_cast<lua_Integer>(i + 1));
+			}
+			_hash.ForEach([state](LuaValue const &key, LuaValue const &value)
 			{
-				_table[ParseValueFromLua(state, -2)] = ParseValueFromLua(state, -1);
+				PushValueToLua(key, state);
+				PushValueToLua(value, state);
+				lua_rawset(state, -3);
+			});
+		}
+
+		void PushFrozen(lua_State *state) const
+		{
+			luaL_checkstack(state, 4, nullptr);
+			PushFrozenCache(state);
+			if (lua_rawgetp(state, -1, _frozen) == LUA_TUSERDATA)
+			{
+				lua_getiuservalue(state, -1, 1);
+				lua_replace(state, -3);
 				lua_pop(state, 1);
-				if (++counter >= 1000)
+				return;
+			}
+			lua_pop(state, 1);
+
+			PushCopy(state);
+			if (_frozen->read_only)
+				MakeReadOnly(state);
+
+			// cache, copy: the anchor holds a reference on _frozen and the copy as user value
+			FrozenState **anchor = static_cast<FrozenState **>(lua_newuserdatauv(state, sizeof(FrozenState *), 1));
+			*anchor = nullptr;
+			PushAnchorMetatable(state);
+			lua_setmetatable(state, -2);
+			*anchor = _frozen;
+			_frozen->AddRef();
+			lua_pushvalue(state, -2);
+			lua_setiuservalue(state, -2, 1);
+			lua_rawsetp(state, -3, _frozen);
+			CountCacheEntry(state, -2);
+			lua_remove(state, -2);
+		}
+
+		static void ReleaseFrozen(FrozenState *frozen)
+		{
+			if (frozen->Release())
+				delete frozen;
+		}
+
+		// the registry table mapping FrozenState addresses to their anchors in this state
+		static void PushFrozenCache(lua_State *state)
+		{
+			static const char key = 0;
+			if (lua_rawgetp(state, LUA_REGISTRYINDEX, &key) == LUA_TTABLE)
+				return;
+
+			lua_pop(state, 1);
+			lua_newtable(state);
+			lua_pushinteger(state, 0);
+			lua_rawseti(state, -2, CacheCount);
+			lua_pushinteger(state, CacheMinSweep);
+			lua_rawseti(state, -2, CacheSweepAt);
+			lua_pushvalue(state, -1);
+			lua_rawsetp(state, LUA_REGISTRYINDEX, &key);
+		}
+
+		static void PushAnchorMetatable(lua_State *state)
+		{
+			static const char key = 0;
+			if (lua_rawgetp(state, LUA_REGISTRYINDEX, &key) == LUA_TTABLE)
+				return;
+
+			lua_pop(state, 1);
+			lua_createtable(state, 0, 2);
+			lua_pushcfunction(state, &ReleaseAnchor);
+			lua_setfield(state, -2, "__gc");
+			lua_pushboolean(state, 0);
+			lua_setfield(state, -2, "__metatable");
+			lua_pushvalue(state, -1);
+			lua_rawsetp(state, LUA_REGISTRYINDEX, &key);
+		}
+
+		static int ReleaseAnchor(lua_State *state)
+		{
+			FrozenState **anchor = static_cast<FrozenState **>(lua_touserdata(state, 1));
+			if (*anchor != nullptr)
+				ReleaseFrozen(*anchor);
+			*anchor = nullptr;
+			return 0;
+		}
+
+		// Counts the entry just added to the cache at index. Once the count doubled since the
+		// last sweep, the entries of destroyed tables are removed, so there are never more of
+		// them than live ones.
+		static void CountCacheEntry(lua_State *state, int cache)
+		{
+			cache = lua_absindex(state, cache);
+			lua_rawgeti(state, cache, CacheCount);
+			lua_Integer count = lua_tointeger(state, -1) + 1;
+			lua_rawgeti(state, cache, CacheSweepAt);
+			lua_Integer sweep_at = lua_tointeger(state, -1);
+			lua_pop(state, 2);
+
+			if (count >= sweep_at)
+			{
+				count = 0;
+				lua_pushnil(state);
+				while (lua_next(state, cache) != 0)
 				{
+					if (lua_type(state, -1) == LUA_TUSERDATA)
+					{
+						FrozenState *frozen = *static_cast<FrozenState **>(lua_touserdata(state, -1));
+						if (frozen->alive.load(std::memory_order_acquire))
+						{
+							++count;
+						}
+						else
+						{
+							lua_pushvalue(state, -2);
+							lua_pushnil(state);
+							lua_rawset(state, cache); // clearing a field during lua_next is allowed
+						}
+					}
 					lua_pop(state, 1);
-					break;
 				}
+				sweep_at = count * 2 > CacheMinSweep ? count * 2 : CacheMinSweep;
+				lua_pushinteger(state, sweep_at);
+				lua_rawseti(state, cache, CacheSweepAt);
 			}
-			recurse_counter--;
+			lua_pushinteger(state, count);
+			lua_rawseti(state, cache, CacheCount);
 		}
 
-		void PushToLua(lua_State *state) const
+		// replaces the table on top of the stack with an empty proxy reading from it
+		static void MakeReadOnly(lua_State *state)
+		{
+			lua_newtable(state); // proxy
+			lua_createtable(state, 0, 5); // metatable
+			lua_pushvalue(state, -3);
+			lua_setfield(state, -2, "__index");
+			lua_pushcfunction(state, &ReadOnlyNewIndex);
+			lua_setfield(state, -2, "__newindex");
+			lua_pushcfunction(state, &ReadOnlyLength);
+			lua_setfield(state, -2, "__len");
+			lua_pushcfunction(state, &ReadOnlyPairs);
+			lua_setfield(state, -2, "__pairs");
+			lua_pushliteral(state, "read-only");
+			lua_setfield(state, -2, "__metatable");
+			lua_setmetatable(state, -2);
+			lua_remove(state, -2);
+		}
+
+		// the proxy's source table is the __index field of its metatable
+		static void PushReadOnlySource(lua_State *state)
+		{
+			lua_getmetatable(state, 1);
+			lua_pushliteral(state, "__index");
+			lua_rawget(state, -2);
+			lua_remove(state, -2);
+		}
+
+		static int ReadOnlyNewIndex(lua_State *state)
+		{
+			return luaL_error(state, "attempt to modify a read-only table");
+		}
+
+		static int ReadOnlyLength(lua_State *state)
+		{
+			PushReadOnlySource(state);
+			lua_pushinteger(state, static_cast<lua_Integer>(lua_rawlen(state, -1)));
+			return 1;
+		}
+
+		static int ReadOnlyPairs(lua_State *state)
+		{
+			lua_pushcfunction(state, &ReadOnlyNext);
+			PushReadOnlySource(state);
+			lua_pushnil(state);
+			return 3;
+		}
+
+		static int ReadOnlyNext(lua_State *state)
+		{
+			lua_settop(state, 2);
+			if (lua_next(state, 1) != 0)
+				return 2;
+			lua_pushnil(state);
+			return 1;
+		}
+
+		struct ParseFrame
+		{
+			LuaTable *table;
+			int index; // absolute stack index of the Lua table
+			const void *pointer;
+			LuaValue key; // converted key of the current entry
+			bool has_key;
+		};
+
+		// converted subtables by Lua table address, so shared references stay shared
+		using ParseMemo = FlatHashMap<const void *, LuaTable *>;
+
+		inline void Clear()
+		{
+			_array.clear();
+			_array_count = 0;
+			_hash.Clear();
+		}
+
+		// Iterative depth-first conversion. The Lua stack holds the key of every table being
+		// iterated plus the nested table itself, all other state lives in frames.
+		const char *ParseTree(lua_State *state, int index, ParseLimits const &limits)
 		{
-			lua_createtable(state, static_cast<int>(_table.size()), 0);
-			for (auto const &e : _table)
+			BeginParse(state, index, this);
+			// the bookkeeping comes from the same resource as the result
+			std::pmr::vector<ParseFrame> frames(_resource != nullptr ? _resource : std::pmr::new_delete_resource());
+			frames.push_back({ this, index, lua_topointer(state, index), LuaValue(), false });
+			ParseMemo memo(_resource);
+			std::size_t entries = 0;
+
+			lua_pushnil(state);
+			for (;;)
 			{
-				PushValueToLua(e.first, state);
-				PushValueToLua(e.second, state);
+				ParseFrame &frame = frames.back();
+				if (!frame.has_key)
+				{
+					if (lua_next(state, frame.index) == 0)
+					{
+						if (frames.size() == 1)
+							return nullptr;
+
+						frames.pop_back();
+						lua_pop(state, 1); // the nested table
+						continue;
+					}
+
+					if (++entries > limits.MaxEntries)
+						return "table has too many entries";
+
+					int key_type = lua_type(state, -2);
+					int value_type = lua_type(state, -1);
+					if (key_type == LUA_TNUMBER && value_type != LUA_TTABLE && frame.table->ParseSequenceValue(state, value_type))
+					{
+						lua_pop(state, 1);
+						continue;
+					}
+					if (key_type == LUA_TTABLE)
+					{
+						// iterate a copy of the key, the original has to stay for lua_next
+						lua_pushvalue(state, -2);
+						LuaTable *child = nullptr;
+						if (const char *failure = EnterSubtable(state, frames, memo, limits, child))
+							return failure;
+
+						frame.key = LuaValue(LuaTable_t(child));
+						frame.has_key = true;
+						if (!lua_isnil(state, -1))
+						{
+							int child_index = lua_gettop(state);
+							BeginParse(state, child_index, child);
+							frames.push_back({ child, child_index, lua_topointer(state, -1), LuaValue(), false });
+							lua_pushnil(state);
+							continue;
+						}
+						lua_pop(state, 1);
+					}
+					else
+					{
+						if (!ParseScalar(state, -2, key_type, frame.key, _resource))
+							return "table contains a key which can't be converted";
+						frame.has_key = true;
+					}
+				}
+
+				// the key is converted, the value is on top of the stack
+				frame.has_key = false;
+				int value_type = lua_type(state, -1);
+				if (value_type == LUA_TTABLE)
+				{
+					LuaTable *child = nullptr;
+					if (const char *failure = EnterSubtable(state, frames, memo, limits, child))
+						return failure;
+
+					frame.table->PresizeHash(state, frame.index);
+					frame.table->SetParsed(std::move(frame.key), LuaValue(LuaTable_t(child)));
+					if (!lua_isnil(state, -1))
+					{
+						int child_index = lua_gettop(state);
+						BeginParse(state, child_index, child);
+						frames.push_back({ child, child_index, lua_topointer(state, -1), LuaValue(), false });
+						lua_pushnil(state);
+						continue;
+					}
+				}
+				else
+				{
+					LuaValue value;
+					if (!ParseScalar(state, -1, value_type, value, _resource))
+						return "table contains a value which can't be converted";
+					frame.table->PresizeHash(state, frame.index);
+					frame.table->SetParsed(std::move(frame.key), std::move(value));
+				}
+				lua_pop(state, 1);
+			}
+		}
+
+		// Resolves the table on top of the stack to an already converted one, or creates a new
+		// one which still has to be parsed. The top is replaced with nil in the first case.
+		static const char *EnterSubtable(lua_State *state, std::pmr::vector<ParseFrame> const &frames,
+			ParseMemo &memo, ParseLimits const &limits, LuaTable *&child)
+		{
+			const void *pointer = lua_topointer(state, -1);
+			for (ParseFrame const &frame : frames)
+			{
+				if (frame.pointer == pointer)
+					return "table contains a reference cycle";
+			}
+
+			if (ParseMemo::Slot *known = memo.Find(pointer))
+			{
+				child = known->second;
+				lua_pop(state, 1);
+				lua_pushnil(state);
+				return nullptr;
+			}
+
+			if (static_cast<int>(frames.size()) > limits.MaxDepth)
+				return "table is nested too deeply";
+			if (!lua_checkstack(state, 8))
+				return "table is nested too deeply for the Lua stack";
+
+			child = Allocate(frames.front().table->_resource);
+			memo.InsertUnique(pointer, child);
+			return nullptr;
+		}
+
+		static bool ParseScalar(lua_State *state, int index, int type, LuaValue &dest,
+			std::pmr::memory_resource *resource)
+		{
+			switch (type)
+			{
+			case LUA_TNUMBER:
+				if (lua_isinteger(state, index))
+					dest = LuaValue(lua_tointeger(state, index));
+				else
+					dest = LuaValue(lua_tonumber(state, index));
+				return true;
+			case LUA_TBOOLEAN:
+				dest = LuaValue(lua_toboolean(state, index) != 0);
+				return true;
+			case LUA_TSTRING:
+			{
+				size_t length = 0;
+				const char *str = lua_tolstring(state, index, &length);
+				dest = LuaValue(std::string_view(str, length), resource);
+				return true;
+			}
+			case LUA_TFUNCTION:
+				dest = ParseValueFromLua(state, index);
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		struct ValidateContext
+		{
+			int visited; // stack index of the visited tables, true while iterated, false after
+			int root;
+			ParseLimits const &limits;
+			std::size_t entries;
+		};
+
+		// Walks the table at index like ParseTree, recursion is bounded by MaxDepth
+		static const char *ValidateTree(lua_State *state, int index, int depth, ValidateContext &context)
+		{
+			lua_pushnil(state);
+			while (lua_next(state, index) != 0)
+			{
+				if (++context.entries > context.limits.MaxEntries)
+					return "table has too many entries";
+
+				int key_type = lua_type(state, -2);
+				if (key_type == LUA_TTABLE)
+				{
+					lua_pushvalue(state, -2);
+					if (const char *failure = ValidateSubtable(state, depth + 1, context))
+						return failure;
+				}
+				else if (!IsScalarType(key_type))
+					return "table contains a key which can't be converted";
+
+				int value_type = lua_type(state, -1);
+				if (value_type == LUA_TTABLE)
+				{
+					lua_pushvalue(state, -1);
+					if (const char *failure = ValidateSubtable(state, depth + 1, context))
+						return failure;
+				}
+				else if (!IsScalarType(value_type))
+					return "table contains a value which can't be converted";
+				lua_pop(state, 1);
+			}
+			return nullptr;
+		}
+
+		// validates and pops the table on top of the stack, checks in the order of EnterSubtable
+		static const char *ValidateSubtable(lua_State *state, int depth, ValidateContext &context)
+		{
+			int index = lua_gettop(state);
+			if (lua_isnil(state, context.visited))
+			{
+				// this is the first nested table, so the converted one is the only one iterated
+				lua_newtable(state);
+				lua_pushvalue(state, context.root);
+				lua_pushboolean(state, 1);
 				lua_rawset(state, -3);
+				lua_replace(state, context.visited);
+			}
+
+			lua_pushvalue(state, index);
+			if (lua_rawget(state, context.visited) != LUA_TNIL)
+			{
+				if (lua_toboolean(state, -1))
+					return "table contains a reference cycle";
+				lua_pop(state, 2); // validated before
+				return nullptr;
+			}
+			lua_pop(state, 1);
+
+			if (depth > context.limits.MaxDepth)
+				return "table is nested too deeply";
+			if (!lua_checkstack(state, 8))
+				return "table is nested too deeply for the Lua stack";
+
+			lua_pushvalue(state, index);
+			lua_pushboolean(state, 1);
+			lua_rawset(state, context.visited);
+			if (const char *failure = ValidateTree(state, index, depth, context))
+				return failure;
+			lua_pushvalue(state, index);
+			lua_pushboolean(state, 0);
+			lua_rawset(state, context.visited);
+			lua_pop(state, 1);
+			return nullptr;
+		}
+
+		// the types ParseScalar converts
+		static inline bool IsScalarType(int type)
+		{
+			return type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING || type == LUA_TFUNCTION;
+		}
+
+		// Lua iterates its array part in order, so sequences end up in the array part without
+		// presizing the hash part, see PresizeHash for that
+		static void BeginParse(lua_State *state, int index, LuaTable *table)
+		{
+			table->Clear();
+
+			// a sparse table can report a huge border, don't trust it beyond a sane size
+			std::size_t border = static_cast<std::size_t>(lua_rawlen(state, index));
+			table->_array.reserve(border < 4096 ? border : 4096);
+		}
+
+		// Called with the key of the current entry at -2 of the Lua table at index. When the hash
+		// part is about to grow, the entries lua_next has left are counted and reserved at once.
+		// Small tables never get here, larger ones count once instead of rehashing repeatedly.
+		void PresizeHash(lua_State *state, int index)
+		{
+			if (!_hash.IsFull())
+				return;
+
+			std::size_t remaining = 1; // the current entry
+			lua_pushvalue(state, -2);
+			while (lua_next(state, index) != 0)
+			{
+				lua_pop(state, 1);
+				++remaining;
 			}
+			_hash.Reserve(_hash.Size() + remaining);
+		}
+
+		LuaValue *FindValue(LuaValue const &key)
+		{
+			if (key.IsInteger())
+			{
+				lua_Integer index = key.AsInteger();
+				if (index >= 1 && index <= static_cast<lua_Integer>(_array.size()))
+				{
+					LuaValue &value = _array[static_cast<std::size_t>(index - 1)];
+					return value.GetType() != LuaValue::Type::INVALID ? &value : nullptr;
+				}
+			}
+
+			auto entry = _hash.Find(key);
+			return entry != nullptr ? &entry->second : nullptr;
+		}
+
+		void Set(LuaValue key, LuaValue value)
+		{
+			if (key.IsInteger())
+			{
+				lua_Integer index = key.AsInteger();
+				if (index >= 1 && index <= static_cast<lua_Integer>(_array.size()))
+				{
+					LuaValue &entry = _array[static_cast<std::size_t>(index - 1)];
+					if (entry.GetType() == LuaValue::Type::INVALID)
+						_array_count++;
+					entry = std::move(value);
+					return;
+				}
+				if (index == static_cast<lua_Integer>(_array.size()) + 1)
+				{
+					_array.push_back(std::move(value));
+					_array_count++;
+
+					// pull the following keys out of the hash part, they belong to the sequence now
+					while (_hash.Size() != 0)
+					{
+						auto next = _hash.Find(LuaValue(static_cast<lua_Integer>(_array.size()) + 1));
+						if (next == nullptr)
+							break;
+
+						_array.push_back(std::move(next->second));
+						_array_count++;
+						_hash.Erase(next->first);
+					}
+					return;
+				}
+			}
+
+			_hash.FindOrInsert(std::move(key)).first->second = std::move(value);
+		}
+
+		// appends the value on top of the stack if the key below it continues the sequence
+		bool ParseSequenceValue(lua_State *state, int value_type)
+		{
+			if (_hash.Size() != 0 || !lua_isinteger(state, -2)
+				|| lua_tointeger(state, -2) != static_cast<lua_Integer>(_array.size()) + 1)
+			{
+				return false;
+			}
+
+			LuaValue value;
+			if (!ParseScalar(state, -1, value_type, value, _resource))
+				return false; // reported by the regular path
+			_array.push_back(std::move(value));
+			_array_count++;
+			return true;
+		}
+
+		// Set for keys coming from lua_next, which are unique and arrive in array order first
+		inline void SetParsed(LuaValue &&key, LuaValue &&value)
+		{
+			if (key.IsInteger() && key.AsInteger() == static_cast<lua_Integer>(_array.size()) + 1
+				&& _hash.Size() == 0)
+			{
+				_array.push_back(std::move(value));
+				_array_count++;
+				return;
+			}
+			if (key.IsInteger())
+				return Set(std::move(key), std::move(value));
+
+			_hash.InsertUnique(std::move(key), std::move(value));
+		}
+
+		bool RemoveValue(LuaValue const &key)
+		{
+			if (key.IsInteger())
+			{
+				lua_Integer index = key.AsInteger();
+				if (index >= 1 && index <= static_cast<lua_Integer>(_array.size()))
+				{
+					LuaValue &entry = _array[static_cast<std::size_t>(index - 1)];
+					if (entry.GetType() == LuaValue::Type::INVALID)
+						return false;
+
+					entry = LuaValue();
+					_array_count--;
+					TrimArray();
+					return true;
+				}
+			}
+
+			return _hash.Erase(key);
+		}
+
+		// drops missing entries from the end of the array part
+		inline void TrimArray()
+		{
+			while (!_array.empty() && _array.back().GetType() == LuaValue::Type::INVALID)
+				_array.pop_back();
+		}
+
+		static LuaTable *Allocate(std::pmr::memory_resource *resource)
+		{
+			if (resource == nullptr)
+				return new LuaTable;
+			return new(resource->allocate(sizeof(LuaTable), alignof(LuaTable))) LuaTable(resource);
 		}
 
 	public: // static helper func
@@ -109,5 +990,36 @@ namespace Lua
 		{
 			return LuaTable_t(new LuaTable);
 		}
+
+		// The table, its storage, nested tables and long strings parsed into it are allocated from
+		// resource, typically an Arena. All handles must be gone before the resource is released.
+		static inline LuaTable_t Create(std::pmr::memory_resource *resource)
+		{
+			return LuaTable_t(Allocate(resource));
+		}
+
+		static void Destroy(LuaTable *table)
+		{
+			std::pmr::memory_resource *resource = table->_resource;
+			if (resource == nullptr)
+			{
+				delete table;
+				return;
+			}
+
+			table->~LuaTable();
+			resource->deallocate(table, sizeof(LuaTable), alignof(LuaTable));
+		}
 	};
+
+	inline void IntrusiveAddRef(LuaTable *ptr)
+	{
+		ptr->AddRef();
+	}
+
+	inline void IntrusiveRelease(LuaTable *ptr)
+	{
+		if (ptr->Release())
+			LuaTable::Destroy(ptr);
+	}
 }
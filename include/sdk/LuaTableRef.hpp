@@ -0,0 +1,440 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "LuaValue.hpp"
+#include "LuaTable.hpp"
+#include "LuaRefPool.hpp"
+
+
+namespace Lua
+{
+	template<typename T, typename Enable>
+	struct Converter; // LuaConverter.hpp, which needs LuaTableRef itself
+
+	// Refers to a Lua table without converting it, fields are fetched and converted when they
+	// are accessed. A stack view (as filled in by ParseArguments) is only valid while the native
+	// function runs, Pin() keeps the table alive in a RefPool slot beyond that.
+	// All access is raw, metamethods are ignored just like when converting a table.
+	class LuaTableRef
+	{
+	private:
+		lua_State *_state = nullptr; // the main thread when pinned
+		int _index = 0; // absolute stack index, 0 when pinned
+		int _ref = LUA_NOREF;
+		RefPoolLink *_link = nullptr; // set when pinned
+
+	public:
+		class Iterator;
+
+		// a key/value pair on the Lua stack, valid until the iterator advances
+		class Entry
+		{
+		private:
+			lua_State *_state;
+			int _key;
+			int _value;
+
+		public:
+			Entry(lua_State *state, int key, int value) :
+				_state(state),
+				_key(key),
+				_value(value)
+			{ }
+
+		public:
+			inline int GetKeyType() const
+			{
+				return lua_type(_state, _key);
+			}
+
+			inline int GetValueType() const
+			{
+				return lua_type(_state, _value);
+			}
+
+			// strings are borrowed, tables are converted
+			inline LuaValue Key() const
+			{
+				return BorrowValueFromLua(_state, _key);
+			}
+
+			inline LuaValue Value() const
+			{
+				return BorrowValueFromLua(_state, _value);
+			}
+
+			template<typename T>
+			bool TryGetKey(T &dest) const
+			{
+				return LuaTableRef::TryConvert(_state, _key, dest);
+			}
+
+			template<typename T>
+			bool TryGetValue(T &dest) const
+			{
+				return LuaTableRef::TryConvert(_state, _value, dest);
+			}
+
+			// a nested table value without converting it
+			inline LuaTableRef Table() const
+			{
+				return lua_istable(_state, _value) ? LuaTableRef(_state, _value) : LuaTableRef();
+			}
+		};
+
+		struct Sentinel { };
+
+		// Walks the table with lua_next. The iteration state lives on the Lua stack, which is
+		// restored when the iterator is destroyed, so leaving a loop early is fine.
+		class Iterator
+		{
+		private:
+			lua_State *_state = nullptr;
+			int _table = 0;
+			int _base = 0;
+			bool _done = true;
+
+		public:
+			Iterator() = default;
+			Iterator(lua_State *state, int table, int base) :
+				_state(state),
+				_table(table),
+				_base(base),
+				_done(false)
+			{
+				lua_pushnil(_state);
+				Next();
+			}
+			~Iterator()
+			{
+				if (_state != nullptr)
+					lua_settop(_state, _base);
+			}
+
+			Iterator(Iterator const &) = delete;
+			Iterator &operator=(Iterator const &) = delete;
+
+		public:
+			inline Entry operator*() const
+			{
+				int top = lua_gettop(_state);
+				return Entry(_state, top - 1, top);
+			}
+
+			inline Iterator &operator++()
+			{
+				lua_pop(_state, 1); // the value, the key stays for lua_next
+				Next();
+				return *this;
+			}
+
+			inline bool operator!=(Sentinel) const
+			{
+				return !_done;
+			}
+
+			inline bool operator==(Sentinel) const
+			{
+				return _done;
+			}
+
+		private:
+			inline void Next()
+			{
+				if (lua_next(_state, _table) == 0)
+					_done = true;
+			}
+		};
+
+	public:
+		LuaTableRef() = default;
+		// stack view on the table at index
+		LuaTableRef(lua_State *state, int index) :
+			_state(state),
+			_index(lua_absindex(state, index))
+		{ }
+		~LuaTableRef()
+		{
+			Unpin();
+		}
+
+		LuaTableRef(LuaTableRef const &) = delete;
+		LuaTableRef &operator=(LuaTableRef const &) = delete;
+
+		LuaTableRef(LuaTableRef &&rhs) noexcept :
+			_state(rhs._state),
+			_index(rhs._index),
+			_ref(rhs._ref),
+			_link(rhs._link)
+		{
+			rhs._state = nullptr;
+			rhs._index = 0;
+			rhs._ref = LUA_NOREF;
+			rhs._link = nullptr;
+		}
+		LuaTableRef &operator=(LuaTableRef &&rhs) noexcept
+		{
+			if (this != &rhs)
+			{
+				Unpin();
+				_state = rhs._state;
+				_index = rhs._index;
+				_ref = rhs._ref;
+				_link = rhs._link;
+				rhs._state = nullptr;
+				rhs._index = 0;
+				rhs._ref = LUA_NOREF;
+				rhs._link = nullptr;
+			}
+			return *this;
+		}
+
+	public:
+		// false once the state of a pinned table is closed
+		inline bool IsValid() const
+		{
+			return IsPinned() ? _link->IsAlive() : _state != nullptr;
+		}
+
+		inline bool IsPinned() const
+		{
+			return _ref != LUA_NOREF;
+		}
+
+		// the main thread for a pinned table, nullptr once its state is closed
+		inline lua_State *GetState() const
+		{
+			return IsValid() ? _state : nullptr;
+		}
+
+		// References the table from a RefPool slot, so it stays valid after the native function
+		// returned. Like LuaFunction it may outlive its state, it becomes invalid when the state
+		// is closed.
+		void Pin()
+		{
+			if (!IsValid() || IsPinned())
+				return;
+
+			lua_pushvalue(_state, _index);
+			Reference(_state, RefPool::GetLink(_state));
+		}
+
+		template<typename K>
+		bool Exists(K const &key) const
+		{
+			if (!IsValid())
+				return false;
+
+			int top = lua_gettop(_state);
+			bool exists = PushField(key) != LUA_TNIL;
+			lua_settop(_state, top);
+			return exists;
+		}
+
+		// converts the field at key like an argument, false if it is missing or doesn't convert
+		template<typename K, typename T>
+		bool TryGet(K const &key, T &dest) const
+		{
+			if (!IsValid())
+				return false;
+
+			int top = lua_gettop(_state);
+			bool result = PushField(key) != LUA_TNIL && TryConvert(_state, -1, dest);
+			lua_settop(_state, top);
+			return result;
+		}
+
+		template<typename T, typename K>
+		T Get(K const &key) const
+		{
+			T value{};
+			TryGet(key, value);
+			return value;
+		}
+
+		// A nested table as a pinned reference, invalid if the field isn't a table. The result owns
+		// its registry slot and releases it when destroyed, the stack is left as it was.
+		template<typename K>
+		LuaTableRef GetTable(K const &key) const
+		{
+			LuaTableRef table;
+			if (!IsValid())
+				return table;
+
+			int top = lua_gettop(_state);
+			if (PushField(key) == LUA_TTABLE)
+				table.Reference(_state, IsPinned() ? _link : RefPool::GetLink(_state));
+			lua_settop(_state, top); // the field, and the table itself if this one is pinned
+			return table;
+		}
+
+		// the border of the table, like the # operator without metamethods
+		inline lua_Integer Length() const
+		{
+			if (!IsValid())
+				return 0;
+
+			if (!IsPinned())
+				return static_cast<lua_Integer>(lua_rawlen(_state, _index));
+
+			RefPool::PushValue(_state, _ref);
+			lua_Integer length = static_cast<lua_Integer>(lua_rawlen(_state, -1));
+			lua_pop(_state, 1);
+			return length;
+		}
+
+		// Converts the whole table like ParseFromLua does, returns an empty handle and sets
+		// error on failure
+		LuaTable_t Materialize(ParseLimits const &limits = ParseLimits(),
+			const char **error = nullptr) const
+		{
+			if (!IsValid())
+				return LuaTable_t();
+
+			int top = lua_gettop(_state);
+			LuaTable_t table(LuaTable::Create());
+			if (!table->ParseFromLua(_state, PushTable(), limits, error))
+				table.reset();
+			lua_settop(_state, top);
+			return table;
+		}
+
+		// pushes nil if the reference is invalid, a pinned table can be pushed to any thread of
+		// its state and a stack view only to its own
+		void PushToLua(lua_State *state) const
+		{
+			if (!IsValid())
+			{
+				lua_pushnil(state);
+				return;
+			}
+
+			if (IsPinned() && (state == _state || GetMainThread(state) == _state))
+				RefPool::PushValue(state, _ref);
+			else if (!IsPinned() && state == _state)
+				lua_pushvalue(_state, _index);
+			else
+				lua_pushnil(state);
+		}
+
+		Iterator begin() const
+		{
+			if (!IsValid())
+				return Iterator();
+
+			int base = lua_gettop(_state);
+			return Iterator(_state, PushTable(), base);
+		}
+
+		inline Sentinel end() const
+		{
+			return Sentinel();
+		}
+
+	private:
+		// pops the table on top of the stack of state into a slot of the pool of link
+		inline void Reference(lua_State *state, RefPoolLink *link)
+		{
+			link->AddRef();
+			_link = link;
+			_ref = RefPool::Ref(state, link);
+			_state = link->state; // the thread state belongs to may be collected before us
+			_index = 0;
+		}
+
+		// does nothing to the slot once the state is closed, see RefPool::Unref
+		inline void Unpin()
+		{
+			if (IsPinned())
+			{
+				RefPool::Unref(_link, _ref);
+				if (_link->Release())
+					delete _link;
+			}
+			_ref = LUA_NOREF;
+			_link = nullptr;
+		}
+
+		// returns the stack index of the table, pushing it if pinned
+		inline int PushTable() const
+		{
+			if (!IsPinned())
+				return _index;
+
+			RefPool::PushValue(_state, _ref);
+			return lua_gettop(_state);
+		}
+
+		// pushes the field at key and returns its type, leaves the stack one or two higher
+		template<typename K>
+		int PushField(K const &key) const
+		{
+			int table = PushTable();
+			if constexpr (std::is_integral<K>::value && !std::is_same<K, bool>::value)
+			{
+				return lua_rawgeti(_state, table, static_cast<lua_Integer>(key));
+			}
+			else
+			{
+				std::string_view name(key);
+				lua_pushlstring(_state, name.data(), name.length());
+				return lua_rawget(_state, table);
+			}
+		}
+
+		// converts like arguments are, see Converter
+		template<typename T>
+		static bool TryConvert(lua_State *state, int index, T &dest)
+		{
+			static_assert(!std::is_same<T, LuaTableRef>::value, "use GetTable or Entry::Table");
+
+			if constexpr (std::is_same<T, LuaValue>::value)
+			{
+				dest = BorrowValueFromLua(state, index);
+				return true;
+			}
+			else
+			{
+				// a view is only safe on a string the table holds, a number would be converted into
+				// a temporary one on the stack
+				if constexpr (std::is_same<T, std::string_view>::value)
+				{
+					if (lua_type(state, index) != LUA_TSTRING)
+						return false;
+				}
+
+				if (!Converter<T, void>::Check(state, index))
+					return false;
+
+				if (lua_type(state, index) != LUA_TNUMBER)
+				{
+					dest = Converter<T, void>::Get(state, index);
+					return true;
+				}
+
+				// from a copy, lua_tolstring would change a key in place and break lua_next
+				lua_pushvalue(state, index);
+				dest = Converter<T, void>::Get(state, -1);
+				lua_pop(state, 1);
+				return true;
+			}
+		}
+	};
+}
@@ -14,12 +14,200 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 
 #pragma once
 
-#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <utility>
 #include <vector>
 
+// Plugins which only ever touch values from one thread can define this as 0 to use plain
+// instead of atomic reference counts
+#ifndef ONSET_SDK_ATOMIC_REFCOUNT
+#define ONSET_SDK_ATOMIC_REFCOUNT 1
+#endif
+
+
 namespace Lua
 {
-	using LuaFunction_t = std::shared_ptr<class LuaFunction>;
-	using LuaTable_t = std::shared_ptr<class LuaTable>;
+	class LuaTable;
+	class LuaFunction;
+
+	// Intrusive reference count for objects held by LuaValue, so a handle is a single pointer
+	class RefCounted
+	{
+	private:
+#if ONSET_SDK_ATOMIC_REFCOUNT
+		mutable std::atomic<int> _ref_count{ 0 };
+#else
+		mutable int _ref_count = 0;
+#endif
+
+	public:
+		RefCounted() = default;
+		// the reference count belongs to the allocation, never copy it
+		RefCounted(RefCounted const &) { }
+		RefCounted &operator=(RefCounted const &) { return *this; }
+
+#if ONSET_SDK_ATOMIC_REFCOUNT
+		inline void AddRef() const
+		{
+			_ref_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// returns true if this was the last reference
+		inline bool Release() const
+		{
+			return _ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+		}
+
+		inline int UseCount() const
+		{
+			return _ref_count.load(std::memory_order_relaxed);
+		}
+#else
+		inline void AddRef() const
+		{
+			++_ref_count;
+		}
+
+		inline bool Release() const
+		{
+			return --_ref_count == 0;
+		}
+
+		inline int UseCount() const
+		{
+			return _ref_count;
+		}
+#endif
+	};
+
+	// defined after the respective class is complete
+	inline void IntrusiveAddRef(LuaTable *ptr);
+	inline void IntrusiveRelease(LuaTable *ptr);
+	inline void IntrusiveAddRef(LuaFunction *ptr);
+	inline void IntrusiveRelease(LuaFunction *ptr);
+
+	// Pointer-sized owning handle with the subset of the std::shared_ptr interface used by plugins
+	template<typename T>
+	class RefPtr
+	{
+	private:
+		T *_ptr = nullptr;
+
+	public:
+		RefPtr() = default;
+		RefPtr(std::nullptr_t) { }
+		explicit RefPtr(T *ptr) : _ptr(ptr)
+		{
+			if (_ptr != nullptr)
+				IntrusiveAddRef(_ptr);
+		}
+		RefPtr(RefPtr const &rhs) : RefPtr(rhs._ptr)
+		{ }
+		RefPtr(RefPtr &&rhs) noexcept : _ptr(rhs._ptr)
+		{
+			rhs._ptr = nullptr;
+		}
+		RefPtr &operator=(RefPtr const &rhs)
+		{
+			RefPtr(rhs).swap(*this);
+			return *this;
+		}
+		RefPtr &operator=(RefPtr &&rhs) noexcept
+		{
+			RefPtr(std::move(rhs)).swap(*this);
+			return *this;
+		}
+		~RefPtr()
+		{
+			if (_ptr != nullptr)
+				IntrusiveRelease(_ptr);
+		}
+
+	public:
+		inline void reset(T *ptr = nullptr)
+		{
+			RefPtr(ptr).swap(*this);
+		}
+
+		inline void swap(RefPtr &rhs) noexcept
+		{
+			std::swap(_ptr, rhs._ptr);
+		}
+
+		// hands the reference over to the caller, who becomes responsible for releasing it
+		inline T *detach()
+		{
+			T *ptr = _ptr;
+			_ptr = nullptr;
+			return ptr;
+		}
+
+		// adopts a reference previously obtained with detach()
+		static inline RefPtr adopt(T *ptr)
+		{
+			RefPtr ref;
+			ref._ptr = ptr;
+			return ref;
+		}
+
+		inline T *get() const
+		{
+			return _ptr;
+		}
+
+		inline int use_count() const
+		{
+			return _ptr != nullptr ? _ptr->UseCount() : 0;
+		}
+
+		inline T *operator->() const
+		{
+			return _ptr;
+		}
+
+		inline T &operator*() const
+		{
+			return *_ptr;
+		}
+
+		inline explicit operator bool() const
+		{
+			return _ptr != nullptr;
+		}
+
+		inline bool operator==(RefPtr const &rhs) const
+		{
+			return _ptr == rhs._ptr;
+		}
+
+		inline bool operator!=(RefPtr const &rhs) const
+		{
+			return _ptr != rhs._ptr;
+		}
+	};
+
+	using LuaFunction_t = RefPtr<LuaFunction>;
+	using LuaTable_t = RefPtr<LuaTable>;
 	using LuaArgs_t = std::vector<class LuaValue>;
+
+	namespace pmr
+	{
+		// argument list allocating from a memory resource, see Lua::Arena
+		using LuaArgs_t = std::pmr::vector<class LuaValue>;
+	}
+}
+
+namespace std
+{
+	template<typename T>
+	struct hash<Lua::RefPtr<T>>
+	{
+		std::size_t operator()(Lua::RefPtr<T> const &ref) const
+		{
+			return std::hash<T *>()(ref.get());
+		}
+	};
 }
@@ -0,0 +1,577 @@
+/*
+Copyright (C) 2019 Blue Mountains GmbH
+
+This program is free software: you can redistribute it and/or modify it under the terms of the Onset
+Open Source License as published by Blue Mountains GmbH.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the Onset Open Source License for more details.
+
+You should have received a copy of the Onset Open Source License along with this program. If not,
+see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "LuaBinding.hpp"
+
+
+namespace Lua
+{
+	// Start of every usertype userdata. object points to the C++ object, destroy is null for a
+	// plain pointer and otherwise destroys the object or handle stored behind the header.
+	struct UsertypeHeader
+	{
+		void *object;
+		void (*destroy)(UsertypeHeader *header);
+	};
+
+	// Exposes C++ class T to Lua as a userdata with methods and properties:
+	//
+	//	Lua::Usertype<Vehicle>(L, "Vehicle")
+	//		.Constructor<int>()                                     // Vehicle.new(model)
+	//		.Method<&Vehicle::Repair>("Repair")                     // vehicle:Repair()
+	//		.Property<&Vehicle::GetHealth, &Vehicle::SetHealth>("health")
+	//		.Property<&Vehicle::model>("model")                     // data members are writable
+	//		.Function<&GetVehicleCount>("GetCount");                // Vehicle.GetCount()
+	//
+	// Objects are pushed as a plain pointer, the object has to outlive it (Push(state, T*) and
+	// returning T* from a bound function), as a RefPtr<T> handle kept until collected (T provides
+	// IntrusiveAddRef and IntrusiveRelease like LuaTable), or by value stored inline in the
+	// userdata (Constructor and Emplace). All share one metatable per type.
+	//
+	// Without properties, the metatable's __index is the method table itself, so obj:Method()
+	// is resolved by the VM without calling into C. Properties add an __index function that
+	// looks up methods first, then getters. Methods check their self argument against the
+	// metatable held in an upvalue, T* and RefPtr<T> parameters of bound functions are checked
+	// through the registry. The name is kept in the metatable, so it's per state like the rest.
+	template<typename T>
+	class Usertype
+	{
+		static_assert(std::is_class<T>::value && !std::is_const<T>::value, "usertypes must be non-const classes");
+
+	private:
+		lua_State *_state;
+
+		static inline const char _key = 0;
+
+		// where a value of type V is stored behind the header
+		template<typename V>
+		static constexpr std::size_t Offset = (sizeof(UsertypeHeader) + alignof(V) - 1) / alignof(V) * alignof(V);
+
+	public:
+		// Creates the metatable and the global class table name, or extends them if the type was
+		// registered before
+		Usertype(lua_State *state, const char *name) : _state(state)
+		{
+			PushMetatable(state);
+			lua_pushstring(state, name);
+			lua_setfield(state, -2, "__name");
+			lua_pushfstring(state, "expected %s", name);
+			lua_setfield(state, -2, "__expected");
+			lua_getfield(state, -1, "__methods");
+			lua_setglobal(state, name);
+			lua_pop(state, 1);
+		}
+
+	public:
+		// Adds name.new(args...), constructing T inline in the userdata
+		template<typename... A>
+		Usertype &Constructor(const char *name = "new")
+		{
+			PushMetatable(_state);
+			lua_getfield(_state, -1, "__methods");
+			lua_pushcfunction(_state, &Construct<A...>);
+			lua_setfield(_state, -2, name);
+			lua_pop(_state, 2);
+			return *this;
+		}
+
+		// Adds obj:name(args...) calling member function Func
+		template<auto Func>
+		Usertype &Method(const char *name)
+		{
+			static_assert(std::is_member_function_pointer<decltype(Func)>::value, "use Function for non-member functions");
+
+			PushMetatable(_state);
+			lua_getfield(_state, -1, "__methods");
+			lua_pushvalue(_state, -2);
+			lua_pushcclosure(_state, &CallMethod<Func>, 1);
+			lua_setfield(_state, -2, name);
+			lua_pop(_state, 2);
+			return *this;
+		}
+
+		// Adds name.function_name(args...), Func and Overloads as in PushNativeFunction. A first
+		// parameter of type T * also allows calling it as obj:function_name(args...).
+		template<auto Func, auto... Overloads>
+		Usertype &Function(const char *function_name)
+		{
+			PushMetatable(_state);
+			lua_getfield(_state, -1, "__methods");
+			if constexpr (sizeof...(Overloads) != 0)
+			{
+				lua_pushfstring(_state, "%s.%s", GetName(_state), function_name);
+				PushNamedFunction<Func, Overloads...>(_state, lua_tostring(_state, -1));
+				lua_remove(_state, -2);
+			}
+			else
+			{
+				PushNativeFunction<Func>(_state);
+			}
+			lua_setfield(_state, -2, function_name);
+			lua_pop(_state, 2);
+			return *this;
+		}
+
+		// Adds obj.name, Getter is a data member or const member function. Setter is a member
+		// function taking the new value; a data member is writable without one unless it's const.
+		template<auto Getter, auto Setter = nullptr>
+		Usertype &Property(const char *name)
+		{
+			PushMetatable(_state);
+			int metatable = lua_gettop(_state);
+
+			lua_getfield(_state, metatable, "__getters");
+			lua_pushcfunction(_state, &GetProperty<Getter>);
+			lua_setfield(_state, -2, name);
+			lua_pop(_state, 1);
+
+			lua_getfield(_state, metatable, "__setters");
+			if constexpr (!std::is_same<decltype(Setter), std::nullptr_t>::value)
+				lua_pushcfunction(_state, &SetProperty<Setter>);
+			else if constexpr (IsWritableMember<decltype(Getter)>::value)
+				lua_pushcfunction(_state, &SetProperty<Getter>);
+			else
+				lua_pushboolean(_state, 0); // read-only
+			lua_setfield(_state, -2, name);
+			lua_pop(_state, 1);
+
+			// methods are now looked up by Index, after the first property
+			lua_getfield(_state, metatable, "__methods");
+			lua_getfield(_state, metatable, "__getters");
+			lua_pushcclosure(_state, &Index, 2);
+			lua_setfield(_state, metatable, "__index");
+			lua_getfield(_state, metatable, "__setters");
+			lua_pushcclosure(_state, &NewIndex, 1);
+			lua_setfield(_state, metatable, "__newindex");
+
+			lua_pop(_state, 1);
+			return *this;
+		}
+
+	public:
+		// Pushes object without taking ownership, nil if it's null
+		static void Push(lua_State *state, T *object)
+		{
+			if (object == nullptr)
+			{
+				lua_pushnil(state);
+				return;
+			}
+			auto header = static_cast<UsertypeHeader *>(lua_newuserdatauv(state, sizeof(UsertypeHeader), 0));
+			header->object = object;
+			header->destroy = nullptr;
+			PushMetatable(state);
+			lua_setmetatable(state, -2);
+		}
+
+		// Pushes a handle keeping object alive until the userdata is collected, nil if it's null
+		static void Push(lua_State *state, RefPtr<T> object)
+		{
+			if (!object)
+			{
+				lua_pushnil(state);
+				return;
+			}
+			T *ptr = object.get();
+			Store<RefPtr<T>>(state, ptr, std::move(object));
+		}
+
+		// Pushes a T constructed from args inline in the userdata
+		template<typename... A>
+		static T *Emplace(lua_State *state, A&&... args)
+		{
+			return Store<T>(state, nullptr, std::forward<A>(args)...);
+		}
+
+		// Returns the object at index, or nullptr if it's not a T
+		static T *Get(lua_State *state, int index)
+		{
+			UsertypeHeader *header = GetHeader(state, index);
+			return header != nullptr ? static_cast<T *>(header->object) : nullptr;
+		}
+
+		// Returns the object at index, raising an argument error if it's not a T
+		static T *Check(lua_State *state, int index)
+		{
+			T *object = Get(state, index);
+			if (object == nullptr)
+				luaL_typeerror(state, index, GetName(state));
+			return object;
+		}
+
+		// Returns the handle at index, or nullptr if it isn't one, e.g. a plain pointer or value
+		static RefPtr<T> GetHandle(lua_State *state, int index)
+		{
+			UsertypeHeader *header = GetHeader(state, index);
+			if (header == nullptr || header->destroy != &Destroy<RefPtr<T>>)
+				return nullptr;
+			return *Stored<RefPtr<T>>(header);
+		}
+
+		// Returns the header if the value at index is a T, else nullptr
+		static UsertypeHeader *GetHeader(lua_State *state, int index)
+		{
+			if (!lua_getmetatable(state, index))
+				return nullptr;
+			lua_rawgetp(state, LUA_REGISTRYINDEX, &_key);
+			bool is_type = lua_rawequal(state, -1, -2);
+			lua_pop(state, 2);
+			if (!is_type)
+				return nullptr;
+			auto header = static_cast<UsertypeHeader *>(lua_touserdata(state, index));
+			return header->object != nullptr ? header : nullptr; // null once collected
+		}
+
+		// the name the type was registered with in state, "userdata" before that
+		static const char *GetName(lua_State *state)
+		{
+			return GetField(state, "__name");
+		}
+
+		// "expected <name>" for argument errors, see Converter<T *>
+		static const char *GetExpected(lua_State *state)
+		{
+			return GetField(state, "__expected");
+		}
+
+		// pushes the metatable, created once per state
+		static void PushMetatable(lua_State *state)
+		{
+			if (lua_rawgetp(state, LUA_REGISTRYINDEX, &_key) == LUA_TTABLE)
+				return;
+
+			lua_pop(state, 1);
+			lua_createtable(state, 0, 8);
+			lua_newtable(state);
+			lua_pushvalue(state, -1);
+			lua_setfield(state, -3, "__methods");
+			lua_setfield(state, -2, "__index");
+			lua_newtable(state);
+			lua_setfield(state, -2, "__getters");
+			lua_newtable(state);
+			lua_setfield(state, -2, "__setters");
+			lua_pushcfunction(state, &Collect);
+			lua_setfield(state, -2, "__gc");
+			lua_pushcfunction(state, &Equal);
+			lua_setfield(state, -2, "__eq");
+			lua_pushboolean(state, 0);
+			lua_setfield(state, -2, "__metatable");
+			lua_pushliteral(state, "userdata");
+			lua_setfield(state, -2, "__name");
+			lua_pushliteral(state, "expected userdata");
+			lua_setfield(state, -2, "__expected");
+			lua_pushvalue(state, -1);
+			lua_rawsetp(state, LUA_REGISTRYINDEX, &_key);
+		}
+
+	private:
+		template<typename M>
+		struct IsWritableMember : std::false_type { };
+
+		template<typename V, typename C>
+		struct IsWritableMember<V C::*> : std::integral_constant<bool,
+			!std::is_function<V>::value && !std::is_const<V>::value> { };
+
+		// a string field of the metatable, which keeps it alive
+		static const char *GetField(lua_State *state, const char *field)
+		{
+			PushMetatable(state);
+			lua_getfield(state, -1, field);
+			const char *value = lua_tostring(state, -1);
+			lua_pop(state, 2);
+			return value;
+		}
+
+		template<typename V>
+		static V *Stored(UsertypeHeader *header)
+		{
+			return reinterpret_cast<V *>(reinterpret_cast<unsigned char *>(header) + Offset<V>);
+		}
+
+		template<typename V>
+		static void Destroy(UsertypeHeader *header)
+		{
+			Stored<V>(header)->~V();
+		}
+
+		// pushes a userdata holding a V constructed from args, a T or the handle to object
+		template<typename V, typename... A>
+		static T *Store(lua_State *state, T *object, A&&... args)
+		{
+			static_assert(alignof(V) <= alignof(void *), "over-aligned usertypes are not supported");
+
+			auto header = static_cast<UsertypeHeader *>(lua_newuserdatauv(state, Offset<V> + sizeof(V), 0));
+			header->object = nullptr;
+			header->destroy = nullptr;
+			V *value = new (Stored<V>(header)) V(std::forward<A>(args)...); // no metatable yet if this throws
+			if constexpr (std::is_same<V, T>::value)
+				header->object = value;
+			else
+				header->object = object;
+			header->destroy = &Destroy<V>;
+			PushMetatable(state);
+			lua_setmetatable(state, -2);
+			return static_cast<T *>(header->object);
+		}
+
+		static int Collect(lua_State *state)
+		{
+			auto header = static_cast<UsertypeHeader *>(lua_touserdata(state, 1));
+			if (header->destroy != nullptr)
+				header->destroy(header);
+			header->object = nullptr;
+			header->destroy = nullptr;
+			return 0;
+		}
+
+		// two userdata referring to the same object are equal
+		static int Equal(lua_State *state)
+		{
+			T *lhs = Get(state, 1);
+			lua_pushboolean(state, lhs != nullptr && lhs == Get(state, 2));
+			return 1;
+		}
+
+		// self for methods, the metatable is the first upvalue
+		static T *CheckSelf(lua_State *state)
+		{
+			if (lua_getmetatable(state, 1))
+			{
+				bool is_type = lua_rawequal(state, -1, lua_upvalueindex(1));
+				lua_pop(state, 1);
+				if (is_type)
+				{
+					void *object = static_cast<UsertypeHeader *>(lua_touserdata(state, 1))->object;
+					if (object != nullptr)
+						return static_cast<T *>(object);
+				}
+			}
+			luaL_typeerror(state, 1, GetName(state));
+			return nullptr;
+		}
+
+		template<typename... A>
+		static int Construct(lua_State *state)
+		{
+			auto construct = [state](A... args)
+			{
+				Emplace(state, static_cast<A&&>(args)...);
+			};
+			CallNative<void(A...)>(state, construct);
+			return 1;
+		}
+
+		template<auto Func>
+		static int CallMethod(lua_State *state)
+		{
+			T *object = CheckSelf(state);
+			auto call = [object](auto&&... args) -> decltype(auto)
+			{
+				return std::invoke(Func, object, std::forward<decltype(args)>(args)...);
+			};
+			return CallNative<decltype(Func), 2>(state, call);
+		}
+
+		// __index with properties, upvalues are the method and getter tables
+		static int Index(lua_State *state)
+		{
+			lua_settop(state, 2);
+			lua_pushvalue(state, 2);
+			if (lua_rawget(state, lua_upvalueindex(1)) != LUA_TNIL)
+				return 1;
+
+			lua_pushvalue(state, 2);
+			if (lua_rawget(state, lua_upvalueindex(2)) == LUA_TNIL)
+				return 1;
+
+			lua_CFunction getter = lua_tocfunction(state, -1);
+			lua_settop(state, 1);
+			return getter(state);
+		}
+
+		// __newindex, the upvalue is the setter table
+		static int NewIndex(lua_State *state)
+		{
+			lua_pushvalue(state, 2);
+			int type = lua_rawget(state, lua_upvalueindex(1));
+			if (type == LUA_TNIL)
+				return luaL_error(state, "%s has no property '%s'", GetName(state), luaL_tolstring(state, 2, nullptr));
+			if (type != LUA_TFUNCTION)
+				return luaL_error(state, "property '%s' of %s is read-only", luaL_tolstring(state, 2, nullptr), GetName(state));
+
+			lua_CFunction setter = lua_tocfunction(state, -1);
+			lua_pop(state, 1);
+			return setter(state);
+		}
+
+		// called by Index with the object at 1, which is known to be a T
+		template<auto Getter>
+		static int GetProperty(lua_State *state)
+		{
+			T *object = static_cast<T *>(static_cast<UsertypeHeader *>(lua_touserdata(state, 1))->object);
+			using Result = typename std::decay<decltype(std::invoke(Getter, *object))>::type;
+			auto get = [object]() -> decltype(auto)
+			{
+				return std::invoke(Getter, *object);
+			};
+			return CallNative<Result()>(state, get);
+		}
+
+		// the value type of a data member or a setter taking one argument
+		template<typename M>
+		struct SetterTraits;
+
+		template<typename V, typename C>
+		struct SetterTraits<V C::*>
+		{
+			using Value = V;
+		};
+
+		template<typename R, typename C, typename V>
+		struct SetterTraits<R(C::*)(V)>
+		{
+			using Value = V;
+		};
+
+		template<typename R, typename C, typename V>
+		struct SetterTraits<R(C::*)(V) noexcept>
+		{
+			using Value = V;
+		};
+
+		// called by NewIndex with the object at 1, key at 2 and value at 3
+		template<auto Setter>
+		static int SetProperty(lua_State *state)
+		{
+			using Value = typename std::decay<typename SetterTraits<decltype(Setter)>::Value>::type;
+			if (!Converter<Value>::Check(state, 3))
+			{
+				return luaL_error(state, "bad value for property '%s' (%s, got %s)", lua_tostring(state, 2),
+					ExpectedOf<Value>(state), luaL_typename(state, 3));
+			}
+
+			T *object = static_cast<T *>(static_cast<UsertypeHeader *>(lua_touserdata(state, 1))->object);
+			auto set = [state, object]()
+			{
+				if constexpr (std::is_member_function_pointer<decltype(Setter)>::value)
+					std::invoke(Setter, *object, Converter<Value>::Get(state, 3));
+				else
+					(*object).*Setter = Converter<Value>::Get(state, 3);
+			};
+			return CallNative<void()>(state, set);
+		}
+	};
+
+	// Usertype pointers, pushed without ownership. Parameters only accept objects of the
+	// registered type, null and nil are not accepted.
+	template<typename T>
+	struct Converter<T *, typename std::enable_if<std::is_class<T>::value>::type>
+	{
+		using Type = typename std::remove_const<T>::type;
+
+		static constexpr const char *Expected = "expected userdata";
+		static constexpr int LuaTypes = TypeBit(LUA_TUSERDATA);
+
+		static inline const char *GetExpected(lua_State *state)
+		{
+			return Usertype<Type>::GetExpected(state);
+		}
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return Usertype<Type>::GetHeader(state, index) != nullptr;
+		}
+
+		static inline T *Get(lua_State *state, int index)
+		{
+			return Usertype<Type>::Get(state, index);
+		}
+
+		static inline int Push(lua_State *state, T *value)
+		{
+			Usertype<Type>::Push(state, const_cast<Type *>(value));
+			return 1;
+		}
+	};
+
+	// Usertype handles, parameters accept only userdata pushed as RefPtr<T>
+	template<typename T>
+	struct Converter<RefPtr<T>, typename std::enable_if<std::is_class<T>::value>::type>
+	{
+		static constexpr const char *Expected = "expected userdata";
+		static constexpr int LuaTypes = TypeBit(LUA_TUSERDATA);
+
+		static inline const char *GetExpected(lua_State *state)
+		{
+			return Usertype<T>::GetExpected(state);
+		}
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return Usertype<T>::GetHandle(state, index) != nullptr;
+		}
+
+		static inline RefPtr<T> Get(lua_State *state, int index)
+		{
+			return Usertype<T>::GetHandle(state, index);
+		}
+
+		static inline int Push(lua_State *state, RefPtr<T> const &value)
+		{
+			Usertype<T>::Push(state, value);
+			return 1;
+		}
+	};
+
+	// Converter for usertypes passed by value, e.g. small math types. Values are copied in and
+	// out of the userdata, it's enabled per type:
+	//
+	//	template<>
+	//	struct Lua::Converter<Vector3> : Lua::UsertypeConverter<Vector3> { };
+	template<typename T>
+	struct UsertypeConverter
+	{
+		static constexpr const char *Expected = "expected userdata";
+		static constexpr int LuaTypes = TypeBit(LUA_TUSERDATA);
+
+		static inline const char *GetExpected(lua_State *state)
+		{
+			return Usertype<T>::GetExpected(state);
+		}
+
+		static inline bool Check(lua_State *state, int index)
+		{
+			return Usertype<T>::GetHeader(state, index) != nullptr;
+		}
+
+		static inline T Get(lua_State *state, int index)
+		{
+			return *Usertype<T>::Get(state, index);
+		}
+
+		static inline int Push(lua_State *state, T const &value)
+		{
+			Usertype<T>::Emplace(state, value);
+			return 1;
+		}
+	};
+}
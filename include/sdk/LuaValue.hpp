@@ -14,14 +14,18 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 
 #pragma once
 
-#include "LuaTypes.hpp"
-
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 
-#ifdef _MSC_VER
-#pragma warning(push)
-// disable union "constructor/desructor not called implicitly" warning
-#pragma warning(disable: 4582 4583)
-#endif
+#include "LuaTypes.hpp"
+#include "LuaBorrow.hpp"
 
 
 namespace Lua
@@ -29,7 +33,7 @@ namespace Lua
 	class LuaValue
 	{
 	public:
-		enum class Type
+		enum class Type : unsigned char
 		{
 			INVALID,
 			NIL,
@@ -41,18 +45,93 @@ namespace Lua
 			FUNCTION
 		};
 
+		// strings up to this length are stored inline, without a heap allocation
+		static constexpr std::size_t SmallStringCapacity = 14;
+
+		// passed to Visit() for values which were never assigned
+		struct Invalid
+		{ };
+
 	private:
-		Type _type;
-		union
-		{
-			lua_Integer Integer;
-			lua_Number Number;
-			bool Boolean;
-			std::string String;
-			LuaTable_t Table;
-			LuaFunction_t Function;
+		// reference counted buffer for strings that don't fit inline
+		struct HeapString : RefCounted
+		{
+			mutable std::atomic<std::uint32_t> Hash{ 0 }; // 0 until first hashed
+			std::pmr::memory_resource *Resource; // nullptr for the global heap
+			std::size_t Length;
+			char Data[1];
+
+			static HeapString *Create(const char *str, std::size_t length,
+				std::pmr::memory_resource *resource = nullptr)
+			{
+				void *memory = resource != nullptr
+					? resource->allocate(sizeof(HeapString) + length, alignof(HeapString))
+					: ::operator new(sizeof(HeapString) + length);
+				HeapString *heap_str = new(memory) HeapString;
+				heap_str->Resource = resource;
+				heap_str->Length = length;
+				std::memcpy(heap_str->Data, str, length);
+				heap_str->Data[length] = '\0';
+				heap_str->AddRef();
+				return heap_str;
+			}
+
+			static void Destroy(HeapString *heap_str)
+			{
+				if (!heap_str->Release())
+					return;
+
+				std::pmr::memory_resource *resource = heap_str->Resource;
+				std::size_t size = sizeof(HeapString) + heap_str->Length;
+				heap_str->~HeapString();
+				if (resource != nullptr)
+					resource->deallocate(heap_str, size, alignof(HeapString));
+				else
+					::operator delete(heap_str);
+			}
 		};
 
+		// immutable string owned by the process-wide atom table, see Intern()
+		struct Atom
+		{
+			std::size_t Length;
+			char Data[1];
+
+			static Atom *FindOrCreate(std::string_view str)
+			{
+				// never destroyed, interned values may outlive static destructors
+				static std::mutex *mutex = new std::mutex;
+				static auto *atoms = new std::unordered_map<std::string_view, Atom *>;
+
+				std::lock_guard<std::mutex> lock(*mutex);
+				auto it = atoms->find(str);
+				if (it != atoms->end())
+					return it->second;
+
+				Atom *atom = new(::operator new(sizeof(Atom) + str.length())) Atom;
+				atom->Length = str.length();
+				std::memcpy(atom->Data, str.data(), str.length());
+				atom->Data[str.length()] = '\0';
+				atoms->emplace(std::string_view(atom->Data, atom->Length), atom);
+				return atom;
+			}
+		};
+
+		// marker in _data[SmallStringCapacity] for strings not stored inline
+		enum StringKind : unsigned char
+		{
+			HEAP_STRING = 0xFF,
+			BORROWED_STRING = 0xFE, // pointer, 32-bit length and BorrowScope id
+			INTERNED_STRING = 0xFD // atom pointer and 32-bit hash
+		};
+
+		// The first 15 bytes hold the payload: an integer, number, boolean or a pointer to
+		// reference counted storage. Inline strings use all of them, the characters are followed
+		// by (SmallStringCapacity - length) in the last byte, which doubles as null terminator
+		// once the string is full. Other string kinds put a StringKind marker into that byte.
+		alignas(8) unsigned char _data[SmallStringCapacity + 1];
+		Type _type;
+
 	public:
 		struct Hash
 		{
@@ -69,22 +148,22 @@ namespace Lua
 				switch (e._type)
 				{
 				case Type::INTEGER:
-					value_hash = std::hash<lua_Integer>()(e.Integer);
+					value_hash = std::hash<lua_Integer>()(e.Load<lua_Integer>());
 					break;
 				case Type::NUMBER:
-					value_hash = std::hash<lua_Number>()(e.Number);
+					value_hash = std::hash<lua_Number>()(e.Load<lua_Number>());
 					break;
 				case Type::BOOLEAN:
-					value_hash = std::hash<bool>()(e.Boolean);
+					value_hash = std::hash<bool>()(e.Load<bool>());
 					break;
 				case Type::STRING:
-					value_hash = std::hash<std::string>()(e.String);
+					value_hash = e.StringHash();
 					break;
 				case Type::TABLE:
-					value_hash = std::hash<LuaTable_t>()(e.Table);
+					value_hash = std::hash<LuaTable *>()(e.Load<LuaTable *>());
 					break;
 				case Type::FUNCTION:
-					value_hash = std::hash<LuaFunction_t>()(e.Function);
+					value_hash = std::hash<LuaFunction *>()(e.Load<LuaFunction *>());
 					break;
 				case Type::INVALID:
 				case Type::NIL:
@@ -100,214 +179,327 @@ namespace Lua
 		};
 
 	public:
-		LuaValue() : _type(Type::INVALID)
+		LuaValue() : _data(), _type(Type::INVALID)
 		{ }
-		LuaValue(std::nullptr_t) : _type(Type::NIL)
+		LuaValue(std::nullptr_t) : _data(), _type(Type::NIL)
 		{ }
 		template<typename T, typename std::enable_if<
 			std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
 			LuaValue(T value) :
-			_type(Type::INTEGER),
-			Integer(static_cast<lua_Integer>(value))
-		{ }
+			_data(),
+			_type(Type::INTEGER)
+		{
+			Store(static_cast<lua_Integer>(value));
+		}
 		LuaValue(double value) :
-			_type(Type::NUMBER),
-			Number(static_cast<lua_Number>(value))
-		{ }
+			_data(),
+			_type(Type::NUMBER)
+		{
+			Store(static_cast<lua_Number>(value));
+		}
 		LuaValue(bool value) :
-			_type(Type::BOOLEAN),
-			Boolean(value)
-		{ }
-		LuaValue(const char *value)
+			_data(),
+			_type(Type::BOOLEAN)
+		{
+			Store(value);
+		}
+		LuaValue(const char *value) : _data()
 		{
 			if (value == nullptr)
-			{
 				_type = Type::NIL;
-			}
 			else
-			{
-				_type = Type::STRING;
-				new(&String) std::string(value);
-			}
+				SetString(value, std::strlen(value));
 		}
-		LuaValue(std::string value) :
-			_type(Type::STRING)
+		LuaValue(const char *value, std::size_t length) : _data()
 		{
-			new(&String) std::string(value);
+			SetString(value, length);
 		}
+		LuaValue(std::string const &value) : _data()
+		{
+			SetString(value.data(), value.length());
+		}
+		LuaValue(std::string_view value) : _data()
+		{
+			SetString(value.data(), value.length());
+		}
+		// a string too long to be stored inline is allocated from resource
+		LuaValue(std::string_view value, std::pmr::memory_resource *resource) : _data()
+		{
+			SetString(value.data(), value.length(), resource);
+		}
+		// an empty handle becomes nil, tables and functions are never null
 		LuaValue(LuaTable_t value) :
-			_type(Type::TABLE)
+			_data(),
+			_type(value ? Type::TABLE : Type::NIL)
 		{
-			new(&Table) std::shared_ptr<LuaTable>(std::move(value));
+			Store(value.detach());
 		}
 		LuaValue(LuaFunction_t value) :
-			_type(Type::FUNCTION)
+			_data(),
+			_type(value ? Type::FUNCTION : Type::NIL)
 		{
-			new(&Function) std::shared_ptr<LuaFunction>(std::move(value));
+			Store(value.detach());
 		}
 
+		// copies of a borrowed or arena-allocated string own their characters
 		LuaValue(LuaValue const &rhs) : _type(rhs._type)
 		{
-			switch (_type)
-			{
-			case Type::NIL:
-				// do nothing
-				break;
-			case Type::INTEGER:
-				Integer = rhs.Integer;
-				break;
-			case Type::NUMBER:
-				Number = rhs.Number;
-				break;
-			case Type::BOOLEAN:
-				Boolean = rhs.Boolean;
-				break;
-			case Type::STRING:
-				new(&String) std::string(rhs.String);
-				break;
-			case Type::TABLE:
-				new(&Table) std::shared_ptr<LuaTable>(rhs.Table);
-				break;
-			case Type::FUNCTION:
-				new(&Function) std::shared_ptr<LuaFunction>(rhs.Function);
-				break;
-			case Type::INVALID:
-				// skip
-				break;
-			}
+			std::memcpy(_data, rhs._data, sizeof(_data));
+			RetainStorage();
 		}
 		LuaValue &operator=(LuaValue const &rhs)
 		{
-			_type = rhs._type;
-			switch (_type)
+			if (this != &rhs)
+				*this = LuaValue(rhs);
+			return *this;
+		}
+
+		// Moves keep the storage, so values can be moved within an arena. A string allocated from
+		// an arena or borrowed from Lua stays so, copy the value to take it out of either.
+		LuaValue(LuaValue &&rhs) noexcept : _type(rhs._type)
+		{
+			std::memcpy(_data, rhs._data, sizeof(_data));
+			rhs._type = Type::INVALID;
+		}
+		LuaValue &operator=(LuaValue &&rhs) noexcept
+		{
+			if (this != &rhs)
 			{
-			case Type::NIL:
-				// do nothing
-				break;
-			case Type::INTEGER:
-				Integer = rhs.Integer;
-				break;
-			case Type::NUMBER:
-				Number = rhs.Number;
-				break;
-			case Type::BOOLEAN:
-				Boolean = rhs.Boolean;
-				break;
-			case Type::STRING:
-				new(&String) std::string(rhs.String);
-				break;
-			case Type::TABLE:
-				new(&Table) std::shared_ptr<LuaTable>(rhs.Table);
-				break;
-			case Type::FUNCTION:
-				new(&Function) std::shared_ptr<LuaFunction>(rhs.Function);
-				break;
-			case Type::INVALID:
-				// skip
-				break;
+				ReleaseStorage();
+				std::memcpy(_data, rhs._data, sizeof(_data));
+				_type = rhs._type;
+				rhs._type = Type::INVALID;
 			}
 			return *this;
 		}
 
-		LuaValue(LuaValue &&rhs) : _type(rhs._type)
+		~LuaValue()
+		{
+			ReleaseStorage();
+		}
+
+		bool operator==(LuaValue const &rhs) const
 		{
+			if (_type != rhs._type)
+				return false;
+
 			switch (_type)
 			{
 			case Type::NIL:
-				// do nothing
-				break;
+				return true;
 			case Type::INTEGER:
-				Integer = rhs.Integer;
-				break;
+				return Load<lua_Integer>() == rhs.Load<lua_Integer>();
 			case Type::NUMBER:
-				Number = rhs.Number;
-				break;
+				return Load<lua_Number>() == rhs.Load<lua_Number>();
 			case Type::BOOLEAN:
-				Boolean = rhs.Boolean;
-				break;
+				return Load<bool>() == rhs.Load<bool>();
 			case Type::STRING:
-				new(&String) std::string(std::move(rhs.String));
-				break;
+				if (_data[SmallStringCapacity] == INTERNED_STRING
+					&& rhs._data[SmallStringCapacity] == INTERNED_STRING)
+				{
+					return Load<Atom *>() == rhs.Load<Atom *>();
+				}
+				return StringView() == rhs.StringView();
 			case Type::TABLE:
-				new(&Table) std::shared_ptr<LuaTable>(std::move(rhs.Table));
-				break;
+				return Load<LuaTable *>() == rhs.Load<LuaTable *>();
 			case Type::FUNCTION:
-				new(&Function) std::shared_ptr<LuaFunction>(std::move(rhs.Function));
-				break;
+				return false; // functions are not comparable
 			case Type::INVALID:
-				// skip
-				break;
+				return false; // invalid type is not comparable
 			}
+
+			return false;
+		}
+
+	public:
+		// Creates a string value pointing at memory owned by someone else, usually the Lua stack
+		// of the running native function. Copying the value creates an owning string.
+		static LuaValue Borrow(const char *str, std::size_t length)
+		{
+			LuaValue value;
+			if (length > UINT32_MAX)
+			{
+				value.SetString(str, length);
+				return value;
+			}
+
+			value._type = Type::STRING;
+			value.Store(str);
+			std::uint32_t borrowed_length = static_cast<std::uint32_t>(length);
+			std::memcpy(value._data + 8, &borrowed_length, sizeof(borrowed_length));
+			std::uint16_t scope_id = BorrowScope::CurrentId();
+			std::memcpy(value._data + 12, &scope_id, sizeof(scope_id));
+			value._data[SmallStringCapacity] = BORROWED_STRING;
+			return value;
 		}
-		LuaValue &operator=(LuaValue &&rhs)
+
+		inline bool IsBorrowed() const
+		{
+			return _type == Type::STRING && _data[SmallStringCapacity] == BORROWED_STRING;
+		}
+
+		// Returns the process-wide unique copy of a string. Interned values carry their hash and
+		// compare by pointer against each other, which makes them the fastest LuaTable keys.
+		// Interned strings are never freed, only use this for a fixed set of names.
+		static LuaValue Intern(std::string_view str)
+		{
+			LuaValue value;
+			value._type = Type::STRING;
+			value.Store(Atom::FindOrCreate(str));
+			std::uint32_t hash = HashString(str);
+			std::memcpy(value._data + 8, &hash, sizeof(hash));
+			value._data[SmallStringCapacity] = INTERNED_STRING;
+			return value;
+		}
+
+		inline bool IsInterned() const
+		{
+			return _type == Type::STRING && _data[SmallStringCapacity] == INTERNED_STRING;
+		}
+
+		// String hashes are kept to 32 bits, so interned values can store them inline
+		static inline std::uint32_t HashString(std::string_view str)
+		{
+			return static_cast<std::uint32_t>(std::hash<std::string_view>()(str));
+		}
+
+	private:
+		template<typename T>
+		inline T Load() const
+		{
+			T value;
+			std::memcpy(&value, _data, sizeof(T));
+			return value;
+		}
+
+		template<typename T>
+		inline void Store(T value)
+		{
+			std::memcpy(_data, &value, sizeof(T));
+		}
+
+		inline bool IsSmallString() const
+		{
+			return _data[SmallStringCapacity] <= SmallStringCapacity;
+		}
+
+		void SetString(const char *str, std::size_t length, std::pmr::memory_resource *resource = nullptr)
+		{
+			_type = Type::STRING;
+			if (length <= SmallStringCapacity)
+			{
+				std::memcpy(_data, str, length);
+				_data[length] = '\0';
+				_data[SmallStringCapacity] = static_cast<unsigned char>(SmallStringCapacity - length);
+			}
+			else
+			{
+				Store(HeapString::Create(str, length, resource));
+				_data[SmallStringCapacity] = HEAP_STRING;
+			}
+		}
+
+		inline std::string_view StringView() const
+		{
+			if (IsSmallString())
+			{
+				return std::string_view(reinterpret_cast<const char *>(_data),
+					SmallStringCapacity - _data[SmallStringCapacity]);
+			}
+
+			if (_data[SmallStringCapacity] == BORROWED_STRING)
+			{
+				std::uint32_t length;
+				std::memcpy(&length, _data + 8, sizeof(length));
+				std::uint16_t scope_id;
+				std::memcpy(&scope_id, _data + 12, sizeof(scope_id));
+				BorrowScope::CheckAlive(scope_id);
+				return std::string_view(Load<const char *>(), length);
+			}
+
+			if (_data[SmallStringCapacity] == INTERNED_STRING)
+			{
+				Atom *atom = Load<Atom *>();
+				return std::string_view(atom->Data, atom->Length);
+			}
+
+			HeapString *heap_str = Load<HeapString *>();
+			return std::string_view(heap_str->Data, heap_str->Length);
+		}
+
+		inline std::uint32_t StringHash() const
+		{
+			std::uint32_t hash;
+			switch (_data[SmallStringCapacity])
+			{
+			case INTERNED_STRING:
+				std::memcpy(&hash, _data + 8, sizeof(hash));
+				return hash;
+			case HEAP_STRING:
+			{
+				HeapString *heap_str = Load<HeapString *>();
+				hash = heap_str->Hash.load(std::memory_order_relaxed);
+				if (hash == 0)
+				{
+					hash = HashString(std::string_view(heap_str->Data, heap_str->Length));
+					heap_str->Hash.store(hash, std::memory_order_relaxed);
+				}
+				return hash;
+			}
+			default:
+				return HashString(StringView());
+			}
+		}
+
+		// called on a fresh bitwise copy
+		inline void RetainStorage()
 		{
-			_type = rhs._type;
 			switch (_type)
 			{
-			case Type::NIL:
-				// do nothing
-				break;
-			case Type::INTEGER:
-				Integer = rhs.Integer;
-				break;
-			case Type::NUMBER:
-				Number = rhs.Number;
-				break;
-			case Type::BOOLEAN:
-				Boolean = rhs.Boolean;
-				break;
 			case Type::STRING:
-				new(&String) std::string(std::move(rhs.String));
+				if (_data[SmallStringCapacity] == HEAP_STRING)
+				{
+					HeapString *heap_str = Load<HeapString *>();
+					if (heap_str->Resource == nullptr)
+						heap_str->AddRef();
+					else
+						Store(HeapString::Create(heap_str->Data, heap_str->Length)); // don't tie the copy to the arena
+				}
+				else if (_data[SmallStringCapacity] == BORROWED_STRING)
+				{
+					std::string_view str = StringView();
+					SetString(str.data(), str.length());
+				}
 				break;
 			case Type::TABLE:
-				new(&Table) std::shared_ptr<LuaTable>(std::move(rhs.Table));
+				IntrusiveAddRef(Load<LuaTable *>());
 				break;
 			case Type::FUNCTION:
-				new(&Function) std::shared_ptr<LuaFunction>(std::move(rhs.Function));
+				IntrusiveAddRef(Load<LuaFunction *>());
 				break;
-			case Type::INVALID:
-				// skip
+			default:
+				// scalars and inline strings are trivially copyable
 				break;
 			}
-			return *this;
-		}
-
-		~LuaValue()
-		{
-			if (_type == Type::STRING)
-				String.~basic_string();
-			else if (_type == Type::TABLE)
-				Table.~shared_ptr();
-			else if (_type == Type::FUNCTION)
-				Function.~shared_ptr();
 		}
 
-		bool operator==(LuaValue const &rhs) const
+		inline void ReleaseStorage()
 		{
-			if (_type != rhs._type)
-				return false;
-
 			switch (_type)
 			{
-			case Type::NIL:
-				return true;
-			case Type::INTEGER:
-				return Integer == rhs.Integer;
-			case Type::NUMBER:
-				return Number == rhs.Number;
-			case Type::BOOLEAN:
-				return Boolean == rhs.Boolean;
 			case Type::STRING:
-				return String.compare(rhs.String) == 0;
+				if (_data[SmallStringCapacity] == HEAP_STRING)
+					HeapString::Destroy(Load<HeapString *>());
+				break;
 			case Type::TABLE:
-				return Table == rhs.Table;
+				IntrusiveRelease(Load<LuaTable *>());
+				break;
 			case Type::FUNCTION:
-				return false; // functions are not comparable
-			case Type::INVALID:
-				return false; // invalid type is not comparable
+				IntrusiveRelease(Load<LuaFunction *>());
+				break;
+			default:
+				break;
 			}
-
-			return false;
 		}
 
 	public:
@@ -352,6 +544,86 @@ namespace Lua
 		}
 
 
+		// Unchecked accessors, the type has to be tested with GetType() or IsX() first.
+		// Nothing is copied, strings and tables are returned by reference.
+		inline lua_Integer AsInteger() const
+		{
+			return Load<lua_Integer>();
+		}
+
+		inline lua_Number AsNumber() const
+		{
+			return Load<lua_Number>();
+		}
+
+		inline bool AsBoolean() const
+		{
+			return Load<bool>();
+		}
+
+		inline std::string_view AsString() const
+		{
+			return StringView();
+		}
+
+		inline LuaTable &AsTable() const
+		{
+			return *Load<LuaTable *>();
+		}
+
+		inline LuaFunction &AsFunction() const
+		{
+			return *Load<LuaFunction *>();
+		}
+
+		// Returns a pointer to the stored value if it holds a T, nullptr otherwise.
+		// T is one of lua_Integer, lua_Number, bool, LuaTable or LuaFunction.
+		template<typename T>
+		inline T const *GetIf() const
+		{
+			if constexpr (std::is_same<T, LuaTable>::value)
+				return _type == Type::TABLE ? Load<LuaTable *>() : nullptr;
+			else if constexpr (std::is_same<T, LuaFunction>::value)
+				return _type == Type::FUNCTION ? Load<LuaFunction *>() : nullptr;
+			else
+			{
+				static_assert(std::is_same<T, lua_Integer>::value || std::is_same<T, lua_Number>::value
+					|| std::is_same<T, bool>::value, "unsupported type for LuaValue::GetIf");
+
+				constexpr Type type = std::is_same<T, bool>::value ? Type::BOOLEAN
+					: (std::is_same<T, lua_Integer>::value ? Type::INTEGER : Type::NUMBER);
+				return _type == type ? std::launder(reinterpret_cast<T const *>(_data)) : nullptr;
+			}
+		}
+
+		// Calls func with the stored value: nullptr for nil, lua_Integer, lua_Number, bool,
+		// std::string_view, LuaTable & or LuaFunction &, and LuaValue::Invalid for invalid values.
+		template<typename F>
+		decltype(auto) Visit(F &&func) const
+		{
+			switch (_type)
+			{
+			case Type::NIL:
+				return func(nullptr);
+			case Type::INTEGER:
+				return func(AsInteger());
+			case Type::NUMBER:
+				return func(AsNumber());
+			case Type::BOOLEAN:
+				return func(AsBoolean());
+			case Type::STRING:
+				return func(AsString());
+			case Type::TABLE:
+				return func(AsTable());
+			case Type::FUNCTION:
+				return func(AsFunction());
+			case Type::INVALID:
+				break;
+			}
+			return func(Invalid());
+		}
+
+
 		template<typename T, typename std::enable_if<
 			std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
 		bool TryGetValue(T &dest) const
@@ -359,7 +631,7 @@ namespace Lua
 			if (_type != Type::INTEGER)
 				return false;
 
-			dest = static_cast<T>(Integer);
+			dest = static_cast<T>(Load<lua_Integer>());
 			return true;
 		}
 
@@ -368,7 +640,7 @@ namespace Lua
 			if (_type != Type::NUMBER)
 				return false;
 
-			dest = static_cast<double>(Number);
+			dest = static_cast<double>(Load<lua_Number>());
 			return true;
 		}
 
@@ -377,7 +649,7 @@ namespace Lua
 			if (_type != Type::NUMBER)
 				return false;
 
-			dest = static_cast<float>(Number);
+			dest = static_cast<float>(Load<lua_Number>());
 			return true;
 		}
 
@@ -386,7 +658,7 @@ namespace Lua
 			if (_type != Type::BOOLEAN)
 				return false;
 
-			dest = Boolean;
+			dest = Load<bool>();
 			return true;
 		}
 
@@ -395,7 +667,18 @@ namespace Lua
 			if (_type != Type::STRING)
 				return false;
 
-			dest = String;
+			std::string_view str = StringView();
+			dest.assign(str.data(), str.length());
+			return true;
+		}
+
+		// the view is valid as long as this value is (or the call frame, for borrowed strings)
+		bool TryGetValue(std::string_view &dest) const
+		{
+			if (_type != Type::STRING)
+				return false;
+
+			dest = StringView();
 			return true;
 		}
 
@@ -404,7 +687,7 @@ namespace Lua
 			if (_type != Type::TABLE)
 				return false;
 
-			dest = Table;
+			dest.reset(Load<LuaTable *>());
 			return true;
 		}
 
@@ -413,7 +696,7 @@ namespace Lua
 			if (_type != Type::FUNCTION)
 				return false;
 
-			dest = Function;
+			dest.reset(Load<LuaFunction *>());
 			return true;
 		}
 
@@ -426,11 +709,11 @@ namespace Lua
 		}
 	};
 
+	static_assert(sizeof(LuaValue) == 16, "LuaValue is expected to be 16 bytes");
+
 	static void PushValueToLua(LuaValue const &value, lua_State *state);
-	static LuaValue ParseValueFromLua(lua_State *state, int index);
+	// strings and tables are allocated from resource if given
+	static LuaValue ParseValueFromLua(lua_State *state, int index,
+		std::pmr::memory_resource *resource = nullptr);
+	inline LuaValue BorrowValueFromLua(lua_State *state, int index);
 }
-
-
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
@@ -24,24 +24,24 @@ namespace Lua
 			lua_pushnil(state);
 			break;
 		case LuaValue::Type::INTEGER:
-			lua_pushinteger(state, static_cast<lua_Integer>(value.GetValue<int>()));
+			lua_pushinteger(state, value.AsInteger());
 			break;
 		case LuaValue::Type::NUMBER:
-			lua_pushnumber(state, static_cast<lua_Number>(value.GetValue<double>()));
+			lua_pushnumber(state, value.AsNumber());
 			break;
 		case LuaValue::Type::BOOLEAN:
-			lua_pushboolean(state, value.GetValue<bool>());
+			lua_pushboolean(state, value.AsBoolean());
 			break;
 		case LuaValue::Type::STRING:
 		{
-			auto str = value.GetValue<std::string>();
-			lua_pushlstring(state, str.c_str(), str.length());
+			std::string_view str = value.AsString();
+			lua_pushlstring(state, str.data(), str.length());
 		} break;
 		case LuaValue::Type::TABLE:
-			value.GetValue<LuaTable_t>()->PushToLua(state);
+			value.AsTable().PushToLua(state);
 			break;
 		case LuaValue::Type::FUNCTION:
-			value.GetValue<LuaFunction_t>()->PushToLua(state);
+			value.AsFunction().PushToLua(state);
 			break;
 		case LuaValue::Type::INVALID:
 			// do nothing
@@ -49,7 +49,7 @@ namespace Lua
 		}
 	}
 
-	static LuaValue ParseValueFromLua(lua_State *state, int index)
+	static LuaValue ParseValueFromLua(lua_State *state, int index, std::pmr::memory_resource *resource)
 	{
 		switch (lua_type(state, index))
 		{
@@ -63,19 +63,26 @@ namespace Lua
 		case LUA_TBOOLEAN:
 			return LuaValue(lua_toboolean(state, index) != 0);
 		case LUA_TSTRING:
-			return LuaValue(lua_tostring(state, index));
+		{
+			size_t length = 0;
+			const char *str = lua_tolstring(state, index, &length);
+			return LuaValue(std::string_view(str, length), resource);
+		}
 		case LUA_TTABLE:
 		{
-			LuaTable_t table(new LuaTable);
-			if (index < 0)
-				index += lua_gettop(state) + 1;
-			table->ParseFromLua(state, index);
+			LuaTable_t table(LuaTable::Create(resource));
+			const char *error = nullptr;
+			if (!table->ParseFromLua(state, index, ParseLimits(), &error))
+			{
+				table.reset(); // luaL_error doesn't unwind
+				luaL_error(state, "%s", error);
+			}
 			return LuaValue(table);
 		}
 		case LUA_TFUNCTION:
 		{
-			LuaFunction_t func(new LuaFunction(state));
-			func->ParseFromLua(index);
+			LuaFunction_t func(new LuaFunction());
+			func->ParseFromLua(state, index);
 			return LuaValue(func);
 		}
 		default:
@@ -84,4 +91,16 @@ namespace Lua
 		}
 		return LuaValue();
 	}
+
+	// Like ParseValueFromLua, but a string is borrowed from the stack instead of copied.
+	// Only valid until the calling native function returns.
+	inline LuaValue BorrowValueFromLua(lua_State *state, int index)
+	{
+		if (lua_type(state, index) != LUA_TSTRING)
+			return ParseValueFromLua(state, index);
+
+		size_t length = 0;
+		const char *str = lua_tolstring(state, index, &length);
+		return LuaValue::Borrow(str, length);
+	}
 }
@@ -14,10 +14,52 @@ see https://bluemountains.io/Onset_OpenSourceSoftware_License.txt
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "LuaTypes.hpp"
+#include "LuaFunctionUtils.hpp"
+#include "LuaArgsView.hpp"
+#include "LuaBorrow.hpp"
 
 namespace Onset
 {
+	// 64-bit FNV-1a hash of text, usable at compile time, e.g. for the name hash of ResolveEvent
+	constexpr std::uint64_t Fnv1a(std::string_view text)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (char c : text)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// An event resolved by IServerPlugin::ResolveEvent, Invalid if it doesn't exist
+	enum class EventHandle : std::uint64_t
+	{
+		Invalid = 0
+	};
+
+	// A native listener added by IServerPlugin::AddNativeEventListener, Invalid if adding failed
+	enum class NativeListenerHandle : std::uint64_t
+	{
+		Invalid = 0
+	};
+
+	// Receives the arguments of an event as a view of the Lua stack
+	using NativeEventListenerFn = void (*)(Lua::LuaArgsView const &Arguments, void *Context);
+
+	// Calls the events queued since the last frame, see IServerPlugin::AddDeferredEventQueue
+	using DrainDeferredEventsFn = std::size_t (*)(void *Context);
+
 	class IBaseInterface
 	{
 	public:
@@ -41,7 +83,146 @@ namespace Onset
 		// Call a remote event
 		virtual void CallRemoteEvent(const char *EventName, Lua::LuaArgs_t *Arguments = nullptr) = 0;
 
+		// Call an event in Lua which was defined by AddEvent. PushArguments is called with the Lua
+		// state of every package handling the event, inside a protected call, and returns the
+		// number of values it pushed.
+		virtual bool CallEvent(const char *EventName, Lua::PushArgumentsFn PushArguments, void *Context) = 0;
+
+		// Look up an event once for calling it repeatedly, NameHash is Fnv1a(EventName). Handles
+		// become invalid when packages are reloaded, the event has to be resolved again then.
+		virtual EventHandle ResolveEvent(const char *EventName, std::uint64_t NameHash) = 0;
+
+		// Call a resolved event, like CallEvent by name but without looking it up. Returns false
+		// only if the handle is invalid or outdated.
+		virtual bool CallEvent(EventHandle Event, Lua::PushArgumentsFn PushArguments, void *Context) = 0;
+
+		// Call a resolved event for Count entries in one go, PushArguments pushes those of one
+		// entry. Each handler gets all entries before the next one: in a single protected call
+		// once per entry (see Lua::CallBatch), or, if added with AddEvent(EventName, handler, true),
+		// once with a table of all entries (see Lua::CallBatchTable). Returns false only if the
+		// handle is invalid or outdated.
+		virtual bool CallEventBatch(EventHandle Event, std::size_t Count, Lua::PushBatchArgumentsFn PushArguments,
+			void *Context) = 0;
+
+		// Call a resolved event and pass the results of each handler to CollectResults, which can
+		// stop the event before the remaining handlers. It's called inside the protected call, so
+		// conversions may raise Lua errors. Returns false only if the handle is invalid or outdated.
+		virtual bool CallEventResults(EventHandle Event, Lua::PushArgumentsFn PushArguments, void *Context,
+			Lua::CollectResultsFn CollectResults, void *ResultsContext) = 0;
+
+		// Listen to an event from C++, whether it's called from Lua or by a plugin. Listener runs
+		// after the Lua handlers with a view of the arguments on the stack, inside the protected
+		// call, so it may raise Lua errors. DestroyContext, if given, is called with Context once
+		// the listener is removed or the server shuts down.
+		virtual NativeListenerHandle AddNativeEventListener(const char *EventName, NativeEventListenerFn Listener,
+			void *Context, void (*DestroyContext)(void *Context)) = 0;
+
+		virtual void RemoveNativeEventListener(NativeListenerHandle Listener) = 0;
+
+		// Call Drain with Context on the game thread once every frame, after the packages'
+		// OnGameTick, until removed. Drain returns the number of events it called, see
+		// DeferredEventQueue.
+		virtual void AddDeferredEventQueue(DrainDeferredEventsFn Drain, void *Context) = 0;
+
+		virtual void RemoveDeferredEventQueue(void *Context) = 0;
+
 		virtual ~IServerPlugin() { }
+
+	private:
+		template<typename T>
+		using IsArgumentsParameter = std::integral_constant<bool, std::is_convertible<T, Lua::LuaArgs_t *>::value
+			|| std::is_convertible<T, Lua::PushArgumentsFn>::value>;
+
+		// whether Args are the PushArguments and Context parameters of the virtual overloads
+		template<typename... Args>
+		struct IsPushCallback : std::false_type { };
+
+		template<typename Callback>
+		static void CallNativeListener(Lua::LuaArgsView const &arguments, void *context)
+		{
+			lua_State *state = arguments.GetState();
+			try
+			{
+				Lua::BorrowScope borrow_scope;
+				(*static_cast<Callback *>(context))(arguments);
+				return;
+			}
+			catch (std::exception const &e)
+			{
+				lua_pushstring(state, e.what());
+			}
+			catch (...)
+			{
+				lua_pushliteral(state, "unknown C++ exception");
+			}
+			lua_error(state); // outside of the handler, the exception is destroyed by now
+		}
+
+		template<typename Callback>
+		static void DestroyNativeListener(void *context)
+		{
+			delete static_cast<Callback *>(context);
+		}
+
+		template<typename F, typename C>
+		struct IsPushCallback<F, C> : std::is_convertible<F, Lua::PushArgumentsFn> { };
+
+	public:
+		// Call an event with arguments pushed directly onto the Lua stack by their Lua::Converter,
+		// without building a LuaArgs_t, e.g. CallEvent("OnVehicleDamage", vehicle, damage)
+		template<typename Arg, typename... Args,
+			typename std::enable_if<!IsArgumentsParameter<Arg>::value, int>::type = 0>
+		inline bool CallEvent(const char *EventName, Arg &&arg, Args&&... args)
+		{
+			auto arguments = std::forward_as_tuple(std::forward<Arg>(arg), std::forward<Args>(args)...);
+			return CallEvent(EventName, &Lua::PushArgumentTuple<decltype(arguments)>, &arguments);
+		}
+
+		inline EventHandle ResolveEvent(const char *EventName)
+		{
+			return ResolveEvent(EventName, Fnv1a(EventName));
+		}
+
+		// Call a resolved event with arguments pushed by their Lua::Converter, a LuaArgs_t passed
+		// by reference is pushed as its values
+		template<typename... Args, typename std::enable_if<!IsPushCallback<Args...>::value, int>::type = 0>
+		inline bool CallEvent(EventHandle Event, Args&&... args)
+		{
+			auto arguments = std::forward_as_tuple(std::forward<Args>(args)...);
+			return CallEvent(Event, &Lua::PushArgumentTuple<decltype(arguments)>, &arguments);
+		}
+
+		// Listen to an event with a callable taking Lua::LuaArgsView const &, e.g.
+		//
+		//	plugin->AddNativeEventListener("OnPlayerChat", [](Lua::LuaArgsView const &args)
+		//	{
+		//		std::string_view message = args.Get<std::string_view>(1); // borrowed, not copied
+		//	});
+		//
+		// C++ exceptions are raised as Lua errors. The callable is destroyed by the server.
+		template<typename F, typename std::enable_if<!std::is_convertible<F, NativeEventListenerFn>::value, int>::type = 0>
+		inline NativeListenerHandle AddNativeEventListener(const char *EventName, F &&callback)
+		{
+			using Callback = typename std::decay<F>::type;
+			return AddNativeEventListener(EventName, &CallNativeListener<Callback>,
+				new Callback(std::forward<F>(callback)), &DestroyNativeListener<Callback>);
+		}
+
+		// Call a resolved event and reduce the results of its handlers with policy, e.g.
+		//
+		//	Onset::AllTrue allowed;
+		//	plugin->CallEventResults(on_enter_vehicle, allowed, player, vehicle);
+		//	if (allowed.Result()) ...
+		//
+		// See FirstNonNil, AllTrue, CollectAll and CollectValues
+		template<typename Policy, typename... Args,
+			typename std::enable_if<!std::is_convertible<Policy &, Lua::PushArgumentsFn>::value, int>::type = 0>
+		inline bool CallEventResults(EventHandle Event, Policy &policy, Args&&... args)
+		{
+			auto arguments = std::forward_as_tuple(std::forward<Args>(args)...);
+			return CallEventResults(Event, &Lua::PushArgumentTuple<decltype(arguments)>, &arguments,
+				&Lua::CollectResultsWith<Policy>, &policy);
+		}
 	};
 
 	class Plugin
@@ -72,4 +253,221 @@ namespace Onset
 			}
 		}
 	};
+
+	// An event name hashed at compile time and resolved on first call, e.g.
+	//
+	//	static Onset::Event on_player_move("OnPlayerMove");
+	//	on_player_move.Call(player, x, y, z);
+	//
+	// A handle outdated by a package reload is resolved again. Not thread-safe, like CallEvent.
+	class Event
+	{
+	private:
+		const char *_name;
+		std::uint64_t _hash;
+		EventHandle _handle = EventHandle::Invalid;
+
+	public:
+		constexpr Event(const char *name) : _name(name), _hash(Fnv1a(name))
+		{ }
+
+	public:
+		inline const char *GetName() const
+		{
+			return _name;
+		}
+
+		// returns false if the event doesn't exist
+		template<typename... Args>
+		bool Call(Args&&... args)
+		{
+			IServerPlugin *plugin = Plugin::Get();
+			if (_handle != EventHandle::Invalid && plugin->CallEvent(_handle, args...))
+				return true;
+
+			_handle = plugin->ResolveEvent(_name, _hash);
+			return _handle != EventHandle::Invalid && plugin->CallEvent(_handle, args...);
+		}
+
+		// see IServerPlugin::CallEventResults, returns false if the event doesn't exist
+		template<typename Policy, typename... Args>
+		bool CallResults(Policy &policy, Args&&... args)
+		{
+			IServerPlugin *plugin = Plugin::Get();
+			if (_handle != EventHandle::Invalid && plugin->CallEventResults(_handle, policy, args...))
+				return true;
+
+			_handle = plugin->ResolveEvent(_name, _hash);
+			return _handle != EventHandle::Invalid && plugin->CallEventResults(_handle, policy, args...);
+		}
+
+		// see IServerPlugin::CallEventBatch, returns false if the event doesn't exist
+		bool CallBatch(std::size_t count, Lua::PushBatchArgumentsFn push_arguments, void *context)
+		{
+			IServerPlugin *plugin = Plugin::Get();
+			if (_handle != EventHandle::Invalid && plugin->CallEventBatch(_handle, count, push_arguments, context))
+				return true;
+
+			_handle = plugin->ResolveEvent(_name, _hash);
+			return _handle != EventHandle::Invalid && plugin->CallEventBatch(_handle, count, push_arguments, context);
+		}
+	};
+
+	// Policies for the results of CallEventResults. They are called with the results of each
+	// handler in turn, returning false ends the event before the remaining handlers.
+
+	// The results of the first handler returning a value other than nil, which ends the event.
+	// They are converted as by LuaFunction::Call, a single Lua::LuaArgs_t takes all of them.
+	template<typename... R>
+	class FirstNonNil
+	{
+	private:
+		Lua::LuaCallResult<R...> _result;
+		bool _found = false;
+
+	public:
+		bool operator()(lua_State *state, int first, int count)
+		{
+			if (count == 0 || lua_isnil(state, first))
+				return true;
+
+			_found = true;
+			Lua::ParseResults(state, first, count, _result);
+			return false;
+		}
+
+		// whether a handler returned a value
+		inline bool Found() const
+		{
+			return _found;
+		}
+
+		// false with an empty error if no handler returned a value
+		inline Lua::LuaCallResult<R...> &GetResult()
+		{
+			return _result;
+		}
+	};
+
+	// Whether no handler objected by returning false, which ends the event. Handlers returning
+	// nothing or nil don't object.
+	class AllTrue
+	{
+	private:
+		bool _result = true;
+
+	public:
+		inline bool operator()(lua_State *state, int first, int count)
+		{
+			if (count > 0 && lua_isboolean(state, first) && !lua_toboolean(state, first))
+				_result = false;
+			return _result;
+		}
+
+		inline bool Result() const
+		{
+			return _result;
+		}
+	};
+
+	// The results of every handler, converted as by LuaFunction::Call
+	template<typename... R>
+	class CollectAll
+	{
+	private:
+		std::vector<Lua::LuaCallResult<R...>> _results;
+
+	public:
+		bool operator()(lua_State *state, int first, int count)
+		{
+			Lua::ParseResults(state, first, count, _results.emplace_back());
+			return true;
+		}
+
+		// one per handler in the order they were called
+		inline std::vector<Lua::LuaCallResult<R...>> &GetResults()
+		{
+			return _results;
+		}
+	};
+
+	// Appends the results of every handler to a LuaArgs_t owned by the caller
+	class CollectValues
+	{
+	private:
+		Lua::LuaArgs_t &_values;
+
+	public:
+		explicit CollectValues(Lua::LuaArgs_t &values) : _values(values)
+		{ }
+
+	public:
+		inline bool operator()(lua_State *state, int first, int count)
+		{
+			for (int i = 0; i < count; ++i)
+				_values.push_back(Lua::ParseValueFromLua(state, first + i));
+			return true;
+		}
+	};
+
+	// Collects the arguments of many calls of one event to pass them to Lua at once, e.g. a
+	// position update per player every tick:
+	//
+	//	static Onset::EventBatch<int, float, float, float> player_moved("OnPlayerMoved");
+	//	for (auto &player : players)
+	//		player_moved.Add(player.id, player.x, player.y, player.z);
+	//	player_moved.Flush();
+	//
+	// Arguments are stored as Args and pushed by their Lua::Converter.
+	template<typename... Args>
+	class EventBatch
+	{
+	private:
+		Event _event;
+		std::vector<std::tuple<Args...>> _entries;
+
+	public:
+		explicit EventBatch(const char *event_name) : _event(event_name)
+		{ }
+
+	public:
+		template<typename... T>
+		inline void Add(T&&... args)
+		{
+			_entries.emplace_back(std::forward<T>(args)...);
+		}
+
+		inline std::size_t Size() const
+		{
+			return _entries.size();
+		}
+
+		inline void Clear()
+		{
+			_entries.clear();
+		}
+
+		// calls the event with all entries and clears them, keeping the memory for the next batch.
+		// Returns false if the event doesn't exist.
+		bool Flush()
+		{
+			if (_entries.empty())
+				return true;
+
+			bool result = _event.CallBatch(_entries.size(), &PushEntry, &_entries);
+			_entries.clear();
+			return result;
+		}
+
+	private:
+		static int PushEntry(lua_State *state, void *context, std::size_t index)
+		{
+			auto &entries = *static_cast<std::vector<std::tuple<Args...>> *>(context);
+			luaL_checkstack(state, static_cast<int>(sizeof...(Args)), "too many arguments");
+			return std::apply([state](auto&... values)
+			{
+				return Lua::ReturnValues(state, values...);
+			}, entries[index]);
+		}
+	};
 }